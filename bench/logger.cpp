@@ -0,0 +1,197 @@
+// Logger benchmark suite: lines/sec and p50/p99/p999 per call latency for every target, with the line style
+// toggled, for 1..N threads and for calls filtered out by the level. Results are printed as JSON.
+// fds 1 and 2 are pointed at /dev/null for the STDOUT/STDERR targets, the JSON goes to the original stdout.
+// usage: utilis_bench_logger [linesPerThread] [maxThreads] [directory]
+#include "my_utils/LatencyHistogram.hpp"
+#include "my_utils/Logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+struct Style {
+    const char* name;
+    bool timestamp;
+    bool level;
+    bool fileInfo;
+};
+
+const Style styles[] = {
+    { "bare", false, false, false },
+    { "level", false, true, false },
+    { "timestamp+level", true, true, false },
+    { "timestamp+level+file", true, true, true },
+};
+
+void applyStyle(const Style& style)
+{
+    LoggerState state = logger.getState();
+    state.timestamp = style.timestamp;
+    state.showLevel = style.level;
+    state.fileInfo = style.fileInfo;
+    logger.setState(state);
+}
+
+struct TargetCase {
+    const char* name;
+    Target target;
+    bool async;
+    bool staged;
+    StagingOrder order;
+};
+
+const TargetCase targets[] = {
+    { "STDOUT", Target::STDOUT, false, false, StagingOrder::PER_THREAD },
+    { "STDOUT staged", Target::STDOUT, false, true, StagingOrder::PER_THREAD },
+    { "STDOUT staged strict", Target::STDOUT, false, true, StagingOrder::STRICT },
+    { "STDERR", Target::STDERR, false, false, StagingOrder::PER_THREAD },
+    { "LOG_FILE", Target::LOG_FILE, false, false, StagingOrder::PER_THREAD },
+    { "LOG_FILE async", Target::LOG_FILE, true, false, StagingOrder::PER_THREAD },
+    { "LOG_BINARY", Target::LOG_BINARY, false, false, StagingOrder::PER_THREAD },
+    { "LOG_MMAP", Target::LOG_MMAP, false, false, StagingOrder::PER_THREAD },
+};
+
+struct Result {
+    double linesPerSec;
+    LatencyHistogram latency;
+};
+
+using Clock = std::chrono::steady_clock;
+
+int64_t elapsedNs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+Result run(unsigned int threads, size_t linesPerThread, bool filtered)
+{
+    std::vector<LatencyHistogram> histograms(threads);
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.emplace_back([t, linesPerThread, filtered, &histograms] {
+            LatencyHistogram& latency = histograms[t];
+            for (size_t i = 0; i < linesPerThread; i++) {
+                Clock::time_point before = Clock::now();
+                if (filtered) {
+                    UTILIS_LOGF_DEBUG("worker {} message {} with a moderately long payload", t, i);
+                } else {
+                    UTILIS_LOGF_INFO("worker {} message {} with a moderately long payload", t, i);
+                }
+                latency.record((uint64_t)elapsedNs(before, Clock::now()));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    // async lines count once they are written
+    logger.flush();
+    double seconds = (double)elapsedNs(start, Clock::now()) / 1e9;
+
+    Result result;
+    result.linesPerSec = (double)linesPerThread * threads / seconds;
+    for (const LatencyHistogram& histogram : histograms) {
+        result.latency.merge(histogram);
+    }
+    return result;
+}
+
+void printResult(FILE* out, bool& first, const char* target, const char* style, unsigned int threads,
+    const Result& result)
+{
+    fprintf(out,
+        "%s\n    {\"target\": \"%s\", \"style\": \"%s\", \"threads\": %u, \"lines_per_sec\": %.0f, "
+        "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, \"mean_ns\": %.1f}",
+        first ? "" : ",", target, style, threads, result.linesPerSec,
+        (unsigned long long)result.latency.percentile(50), (unsigned long long)result.latency.percentile(99),
+        (unsigned long long)result.latency.percentile(99.9), (unsigned long long)result.latency.max(),
+        result.latency.mean());
+    first = false;
+    fflush(out);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t linesPerThread = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+    unsigned int maxThreads = argc > 2 ? (unsigned int)atoi(argv[2]) : std::thread::hardware_concurrency();
+    std::string directory = argc > 3 ? argv[3] : "/tmp";
+    if (maxThreads == 0) {
+        maxThreads = 1;
+    }
+
+    FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+    close(devNull);
+
+    std::string textFile = directory + "/utilis_bench_logger.log";
+    std::string binaryFile = directory + "/utilis_bench_logger.bin";
+    std::string mmapFile = directory + "/utilis_bench_logger.mmap";
+    logger.setLevel(Level::INFO);
+    logger.setFile(textFile, true);
+    logger.setBinaryFile(binaryFile, true);
+    logger.setMmapFile(mmapFile, true);
+
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    // what an empty latency sample measures, included in every p50/p99/p999
+    LatencyHistogram clockOverhead;
+    for (int i = 0; i < 100000; i++) {
+        Clock::time_point before = Clock::now();
+        clockOverhead.record((uint64_t)elapsedNs(before, Clock::now()));
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"utilis_bench_logger\",\n  \"lines_per_thread\": %zu,\n", linesPerThread);
+    fprintf(out, "  \"clock_overhead_p50_ns\": %llu,\n  \"results\": [",
+        (unsigned long long)clockOverhead.percentile(50));
+    bool first = true;
+    for (const TargetCase& target : targets) {
+        logger.setTarget(target.target);
+        if (target.async) {
+            logger.enableAsync();
+        }
+        if (target.staged) {
+            logger.enableStaging(target.order);
+        }
+        for (const Style& style : styles) {
+            applyStyle(style);
+            for (unsigned int threads : threadCounts) {
+                printResult(out, first, target.name, style.name, threads, run(threads, linesPerThread, false));
+            }
+        }
+        if (target.async) {
+            logger.disableAsync();
+        }
+        if (target.staged) {
+            logger.disableStaging();
+        }
+    }
+
+    // below the level nothing but the isEnabled() check runs, the target doesn't matter
+    logger.setTarget(Target::LOG_FILE);
+    const Style& filteredStyle = styles[2];
+    applyStyle(filteredStyle);
+    for (unsigned int threads : threadCounts) {
+        printResult(out, first, "filtered", filteredStyle.name, threads, run(threads, linesPerThread, true));
+    }
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+
+    logger.setTarget(Target::DISABLED);
+    unlink(textFile.c_str());
+    unlink(binaryFile.c_str());
+    unlink(mmapFile.c_str());
+    return 0;
+}
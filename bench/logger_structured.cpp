@@ -0,0 +1,93 @@
+// Structured logging benchmark: cost of rendering one record with kv() fields as the text line, JSON and logfmt,
+// and the same through the Logger into a file.
+// usage: utilis_bench_logger_structured [records] [file]
+#include "my_utils/Logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+namespace {
+const char* const format = "order {} placed";
+
+template <typename Render>
+void benchRender(const char* name, size_t records, Render&& render)
+{
+    LineBuffer out;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records; i++) {
+        out.clear();
+        render(out, i);
+        bytes += out.size;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-18s %12.1f %14.0f %12.1f\n", name, seconds * 1e9 / records, records / seconds, (double)bytes / records);
+}
+
+void packArgs(LogArgs& args, size_t i)
+{
+    args.clear();
+    args.add(i);
+    args.add(kv("id", i * 7));
+    args.add(kv("ms", 3.25 + (double)(i & 7)));
+    args.add(kv("user", "alice \"al\" smith"));
+    args.add(kv("ok", (i & 1) == 0));
+}
+
+void benchLogger(const char* name, size_t records, std::shared_ptr<LogFormatter> formatter)
+{
+    logger.getTargetSink(Target::LOG_FILE)->setFormatter(std::move(formatter));
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records; i++) {
+        logger.info(format, i, kv("id", i * 7), kv("ms", 3.25 + (double)(i & 7)), kv("user", "alice \"al\" smith"),
+            kv("ok", (i & 1) == 0));
+    }
+    logger.flush();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-18s %12.1f %14.0f\n", name, seconds * 1e9 / records, records / seconds);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t records = argc > 1 ? (size_t)atol(argv[1]) : 500000;
+    std::string file = argc > 2 ? argv[2] : "/dev/null";
+
+    logger.setFile(file);
+    logger.setTarget(Target::LOG_FILE);
+    logger.setLevel(Level::INFO);
+    logger.includeFunctionInfo();
+    logger.setTimestampPrecision(TimestampPrecision::MICROSECONDS);
+
+    LogArgs args;
+    LineBuffer message;
+    JsonFormatter json;
+    LogfmtFormatter logfmt;
+    auto entryFor = [&](size_t i) {
+        packArgs(args, i);
+        LogEntry entry;
+        entry.level = Level::INFO;
+        entry.time = logger.timestampNow();
+        entry.format = format;
+        entry.args = &args;
+        return entry;
+    };
+
+    printf("render only\n%-18s %12s %14s %12s\n", "format", "ns/record", "records/sec", "bytes");
+    benchRender("text", records, [&](LineBuffer& out, size_t i) {
+        LogEntry entry = entryFor(i);
+        message.clear();
+        formatLogMessage(message, entry.format, args.data(), args.size());
+        logger.appendLine(out, entry.level, message.c_str(), entry.location, entry.time);
+    });
+    benchRender("json", records, [&](LineBuffer& out, size_t i) { json.format(out, entryFor(i), logger); });
+    benchRender("logfmt", records, [&](LineBuffer& out, size_t i) { logfmt.format(out, entryFor(i), logger); });
+
+    printf("\nthrough the Logger to %s\n%-18s %12s %14s\n", file.c_str(), "format", "ns/record", "records/sec");
+    benchLogger("text", records, nullptr);
+    benchLogger("json", records, std::make_shared<JsonFormatter>());
+    benchLogger("logfmt", records, std::make_shared<LogfmtFormatter>());
+    return 0;
+}
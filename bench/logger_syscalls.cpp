@@ -0,0 +1,106 @@
+// Write syscalls per logged line with STDOUT, STDERR and LOG_FILE all enabled.
+// fds 1 and 2 are pointed at /dev/null, syscalls are counted with the syscw field of /proc/self/io.
+// The first case only replays the syscall pattern of the stdio based targets, its time isn't comparable.
+// usage: utilis_bench_logger_syscalls [lines] [file]
+#include "my_utils/Logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+namespace {
+int report = -1; // the original stdout
+
+uint64_t writeSyscalls()
+{
+    FILE* io = fopen("/proc/self/io", "r");
+    if (!io) {
+        return 0;
+    }
+    char line[128];
+    uint64_t count = 0;
+    while (fgets(line, sizeof(line), io)) {
+        if (strncmp(line, "syscw:", 6) == 0) {
+            count = strtoull(line + 6, nullptr, 10);
+        }
+    }
+    fclose(io);
+    return count;
+}
+
+template <typename Body>
+void bench(const char* name, size_t lines, Body&& body)
+{
+    uint64_t before = writeSyscalls();
+    auto start = std::chrono::steady_clock::now();
+    body();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // the two /proc reads don't count as writes
+    uint64_t syscalls = writeSyscalls() - before;
+    dprintf(report, "%-36s %12.4f %12.1f\n", name, (double)syscalls / (double)lines, seconds * 1e9 / (double)lines);
+}
+
+void logLines(size_t lines)
+{
+    for (size_t i = 0; i < lines; i++) {
+        logger.logInfo("worker message with a moderately long payload to format and write");
+    }
+    logger.flush();
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t lines = argc > 1 ? (size_t)atol(argv[1]) : 200000;
+    std::string file = argc > 2 ? argv[2] : "/dev/null";
+
+    report = dup(STDOUT_FILENO);
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+    close(devNull);
+
+    dprintf(report, "%-36s %12s %12s\n", "", "syscalls/line", "ns/line");
+
+    // a simulation of what the targets did before, not the old Logger code: stdio for stdout (buffered, fd 1 is
+    // not a terminal) and stderr (unbuffered), one write(2) per line for the file, no formatting
+    bench("simulated stdio + write(2) per line", lines, [&] {
+        int fd = open(file.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0666);
+        const char line[] = "[17/Oct/2026 11:46:00] INFO worker message with a moderately long payload\n";
+        for (size_t i = 0; i < lines; i++) {
+            fwrite(line, 1, sizeof(line) - 1, stdout);
+            fwrite(line, 1, sizeof(line) - 1, stderr);
+            if (write(fd, line, sizeof(line) - 1) < 0) {
+                break;
+            }
+        }
+        fflush(stdout);
+        close(fd);
+    });
+
+    logger.setFile(file);
+    logger.setLevel(Level::INFO);
+    logger.setTarget(Target::STDOUT);
+    logger.orTarget(Target::STDERR);
+    logger.orTarget(Target::LOG_FILE);
+
+    bench("Logger sync, flush every line", lines, [&] { logLines(lines); });
+
+    LogFlushPolicy buffered;
+    buffered.everyLine = false;
+    buffered.maxBufferedBytes = 64 * 1024;
+    logger.setFlushPolicy(buffered);
+    bench("Logger sync, flush every 64 KiB", lines, [&] { logLines(lines); });
+
+    logger.setFlushPolicy(LogFlushPolicy());
+    logger.enableAsync();
+    bench("Logger async, flush every batch", lines, [&] { logLines(lines); });
+
+    logger.setFlushPolicy(buffered);
+    bench("Logger async, flush every 64 KiB", lines, [&] { logLines(lines); });
+    logger.disableAsync();
+    return 0;
+}
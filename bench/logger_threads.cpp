@@ -0,0 +1,50 @@
+// Multi-threaded Logger stress benchmark: lines/sec for 1..N threads writing to one LOG_FILE.
+// usage: utilis_bench_logger_threads [maxThreads] [linesPerThread] [file]
+#include "my_utils/Logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    unsigned int maxThreads = argc > 1 ? (unsigned int)atoi(argv[1]) : std::thread::hardware_concurrency();
+    size_t linesPerThread = argc > 2 ? (size_t)atol(argv[2]) : 200000;
+    std::string file = argc > 3 ? argv[3] : "/dev/null";
+    if (maxThreads == 0) {
+        maxThreads = 1;
+    }
+
+    logger.setTarget(Target::DISABLED);
+    logger.setFile(file);
+    logger.includeFunctionInfo();
+    logger.setLevel(Level::INFO);
+
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    printf("%8s %14s %14s\n", "threads", "lines/sec", "ns/line");
+    for (unsigned int threads : threadCounts) {
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.emplace_back([linesPerThread] {
+                for (size_t i = 0; i < linesPerThread; i++) {
+                    logger.logInfo("worker message with a moderately long payload to format and write");
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double lines = (double)linesPerThread * threads;
+        printf("%8u %14.0f %14.1f\n", threads, lines / seconds, seconds * 1e9 / lines);
+    }
+    return 0;
+}
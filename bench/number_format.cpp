@@ -0,0 +1,74 @@
+// Number formatting microbenchmark: NumberFormat.hpp kernels against snprintf, std::to_chars and std::to_string.
+// usage: utilis_bench_number_format [count]
+#include "my_utils/NumberFormat.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+size_t sink = 0; // keeps the results alive
+
+template <typename T, typename Format>
+void bench(const char* name, const std::vector<T>& values, Format&& format)
+{
+    char out[64];
+    auto start = std::chrono::steady_clock::now();
+    for (T value : values) {
+        sink += format(out, value);
+        sink += (unsigned char)out[0];
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-24s %10.2f\n", name, seconds * 1e9 / values.size());
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : 2000000;
+    std::mt19937_64 random(42);
+    std::vector<uint64_t> integers(count);
+    std::vector<double> doubles(count);
+    for (size_t i = 0; i < count; i++) {
+        // spread over all magnitudes, most logged numbers are small
+        integers[i] = random() >> (random() % 64);
+        doubles[i] = std::ldexp((double)(random() >> 11) / (double)(1ull << 53), (int)(random() % 80) - 40);
+    }
+
+    printf("%-24s %10s\n", "unsigned 64", "ns/value");
+    bench("formatUnsigned", integers, [](char* out, uint64_t v) { return formatUnsigned(out, v); });
+    bench("std::to_chars", integers, [](char* out, uint64_t v) { return (size_t)(std::to_chars(out, out + 64, v).ptr - out); });
+    bench("snprintf %llu", integers, [](char* out, uint64_t v) { return (size_t)snprintf(out, 64, "%llu", (unsigned long long)v); });
+    bench("std::to_string", integers, [](char* out, uint64_t v) {
+        std::string text = std::to_string(v);
+        memcpy(out, text.data(), text.size());
+        return text.size();
+    });
+
+    printf("\n%-24s %10s\n", "double", "ns/value");
+    bench("formatDouble", doubles, [](char* out, double v) { return formatDouble(out, v); });
+    bench("std::to_chars", doubles, [](char* out, double v) { return (size_t)(std::to_chars(out, out + 64, v).ptr - out); });
+    bench("snprintf %.17g", doubles, [](char* out, double v) { return (size_t)snprintf(out, 64, "%.17g", v); });
+    bench("snprintf %g (lossy)", doubles, [](char* out, double v) { return (size_t)snprintf(out, 64, "%g", v); });
+    bench("std::to_string (lossy)", doubles, [](char* out, double v) {
+        std::string text = std::to_string(v);
+        memcpy(out, text.data(), text.size());
+        return text.size();
+    });
+
+    // every kernel result has to parse back to the same value
+    size_t mismatches = 0;
+    char out[numberFormatMaxChars + 1];
+    for (size_t i = 0; i < count; i++) {
+        out[formatUnsigned(out, integers[i])] = '\0';
+        mismatches += strtoull(out, nullptr, 10) != integers[i];
+        out[formatDouble(out, doubles[i])] = '\0';
+        mismatches += strtod(out, nullptr) != doubles[i];
+    }
+    printf("\nround trip mismatches: %zu\n", mismatches);
+    return sink == 0 ? 1 : (mismatches ? 2 : 0);
+}
@@ -0,0 +1,65 @@
+// Profiler aggregation microbenchmark: per-sample cost with 10, 100 and 1000 distinct timer names.
+// usage: utilis_bench_profiler [samples] [threads]
+#include "my_utils/Profiler.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+template <typename Record>
+double bench(size_t samples, int threads, size_t names, Record&& record)
+{
+    Profiler::getInstance()->clearSamples();
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            // threads start on different names so they don't all hit one slot
+            for (size_t i = 0; i < samples; i++) {
+                record((i + (size_t)t * 7) % names);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return seconds * 1e9 / (double)(samples * (size_t)threads);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    size_t samples = argc > 1 ? (size_t)atol(argv[1]) : 2000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 1;
+    Profiler* profiler = Profiler::getInstance();
+
+    printf("%zu samples x %d threads, ns/sample\n", samples, threads);
+    printf("%-8s %12s %12s %12s\n", "names", "AddSample", "PTimer", "by name");
+    for (size_t names : { 10, 100, 1000 }) {
+        std::vector<std::string> timerNames;
+        std::vector<ProfilerSlot*> slots;
+        for (size_t i = 0; i < names; i++) {
+            timerNames.push_back("bench.timer." + std::to_string(names) + "." + std::to_string(i));
+            slots.push_back(profiler->intern(timerNames.back()));
+        }
+        // interned slot, what newTimer() does
+        double interned = bench(samples, threads, names, [&](size_t i) { profiler->AddSample(slots[i], 1); });
+        // a whole timer: two clock reads and the add
+        double timer = bench(samples, threads, names, [&](size_t i) { PTimer timer(slots[i]); });
+        // the name is hashed on every sample
+        double byName = bench(samples, threads, names, [&](size_t i) { profiler->AddSample(Sample(timerNames[i], 1)); });
+        printf("%-8zu %12.2f %12.2f %12.2f\n", names, interned, timer, byName);
+    }
+
+    // the totals have to add up, one per AddSample() call of the last round
+    long total = 0;
+    for (auto const& sample : profiler->getTimings()) {
+        total += sample.nsTime;
+    }
+    printf("\nlast round total: %ld of %zu\n", total, samples * (size_t)threads);
+    return total == (long)(samples * (size_t)threads) ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+#ifndef INI_READER_HPP
+#define INI_READER_HPP
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Utilis {
+
+// Reader for INI files:
+//   ; comment            # comment
+//   key = value          keys before the first section belong to the section ""
+//   [section]
+//   key = "quoted value ; with \"escapes\"\n"
+//   key = value ; inline comment after whitespace
+// Section and key names are matched case insensitively, the last of duplicate keys wins in get().
+// Lines that can't be parsed are skipped and reported by getErrors().
+class IniReader {
+public:
+    IniReader() = default;
+
+    /* Parse INI text, replacing what was read before.
+     *
+     * \param	string	The text
+     * \return	bool	false if some line could not be parsed, see getErrors()
+     */
+    bool parse(const std::string& text)
+    {
+        this->sections.clear();
+        this->errors.clear();
+        this->sections.push_back(Section());
+        std::istringstream stream(text);
+        std::string line;
+        for (size_t number = 1; std::getline(stream, line); number++) {
+            parseLine(line, number);
+        }
+        return this->errors.empty();
+    }
+
+    /* Read and parse a file.
+     *
+     * \param	string	File name
+     * \return	bool	false if the file can't be read or some line could not be parsed, see getErrors()
+     */
+    bool load(const std::string& fileName)
+    {
+        std::ifstream file(fileName);
+        if (!file.is_open()) {
+            this->sections.clear();
+            this->errors.assign(1, "cannot open");
+            return false;
+        }
+        std::ostringstream text;
+        text << file.rdbuf();
+        return parse(text.str());
+    }
+
+    bool hasSection(const std::string& section) const { return findSection(section) != nullptr; }
+
+    bool has(const std::string& section, const std::string& key) const { return findValue(section, key) != nullptr; }
+
+    /* \param	string	Section name, "" for keys before the first section
+     * \param	string	Key
+     * \param	string	Returned if the key is missing
+     * \return	string	The value, unquoted
+     */
+    std::string get(const std::string& section, const std::string& key, const std::string& fallback = "") const
+    {
+        const std::string* value = findValue(section, key);
+        return value ? *value : fallback;
+    }
+
+    /* true/yes/on/1 and false/no/off/0, anything else returns the fallback.
+     */
+    bool getBool(const std::string& section, const std::string& key, bool fallback) const
+    {
+        const std::string* value = findValue(section, key);
+        if (!value) {
+            return fallback;
+        }
+        for (const char* word : { "true", "yes", "on", "1" }) {
+            if (equalsIgnoreCase(*value, word)) {
+                return true;
+            }
+        }
+        for (const char* word : { "false", "no", "off", "0" }) {
+            if (equalsIgnoreCase(*value, word)) {
+                return false;
+            }
+        }
+        return fallback;
+    }
+
+    long getInt(const std::string& section, const std::string& key, long fallback) const
+    {
+        const std::string* value = findValue(section, key);
+        if (!value || value->empty()) {
+            return fallback;
+        }
+        char* end;
+        long number = strtol(value->c_str(), &end, 0);
+        return *end == '\0' ? number : fallback;
+    }
+
+    double getDouble(const std::string& section, const std::string& key, double fallback) const
+    {
+        const std::string* value = findValue(section, key);
+        if (!value || value->empty()) {
+            return fallback;
+        }
+        char* end;
+        double number = strtod(value->c_str(), &end);
+        return *end == '\0' ? number : fallback;
+    }
+
+    /* Section names in file order, "" first.
+     */
+    std::vector<std::string> getSections() const
+    {
+        std::vector<std::string> names;
+        for (const Section& section : this->sections) {
+            names.push_back(section.name);
+        }
+        return names;
+    }
+
+    /* All key/value pairs of a section in file order, duplicates included.
+     */
+    std::vector<std::pair<std::string, std::string>> getEntries(const std::string& section) const
+    {
+        std::vector<std::pair<std::string, std::string>> entries;
+        for (const Section& candidate : this->sections) {
+            if (equalsIgnoreCase(candidate.name, section)) {
+                entries.insert(entries.end(), candidate.entries.begin(), candidate.entries.end());
+            }
+        }
+        return entries;
+    }
+
+    // "line 3: ..." messages of the last parse()/load()
+    const std::vector<std::string>& getErrors() const { return this->errors; }
+
+private:
+    struct Section {
+        std::string name;
+        std::vector<std::pair<std::string, std::string>> entries;
+    };
+    std::vector<Section> sections;
+    std::vector<std::string> errors;
+
+    static bool equalsIgnoreCase(const std::string& a, const std::string& b)
+    {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string trim(const std::string& text)
+    {
+        size_t begin = 0;
+        size_t end = text.size();
+        while (begin < end && isspace((unsigned char)text[begin])) {
+            begin++;
+        }
+        while (end > begin && isspace((unsigned char)text[end - 1])) {
+            end--;
+        }
+        return text.substr(begin, end - begin);
+    }
+
+    const Section* findSection(const std::string& name) const
+    {
+        for (const Section& section : this->sections) {
+            if (equalsIgnoreCase(section.name, name)) {
+                return &section;
+            }
+        }
+        return nullptr;
+    }
+
+    const std::string* findValue(const std::string& section, const std::string& key) const
+    {
+        const std::string* found = nullptr;
+        // sections may be repeated, later ones override
+        for (const Section& candidate : this->sections) {
+            if (!equalsIgnoreCase(candidate.name, section)) {
+                continue;
+            }
+            for (const auto& entry : candidate.entries) {
+                if (equalsIgnoreCase(entry.first, key)) {
+                    found = &entry.second;
+                }
+            }
+        }
+        return found;
+    }
+
+    void fail(size_t number, const std::string& message)
+    {
+        this->errors.push_back("line " + std::to_string(number) + ": " + message);
+    }
+
+    void parseLine(const std::string& raw, size_t number)
+    {
+        std::string line = trim(raw);
+        if (line.empty() || line[0] == ';' || line[0] == '#') {
+            return;
+        }
+        if (line[0] == '[') {
+            size_t close = line.find(']');
+            if (close == std::string::npos) {
+                fail(number, "missing ']'");
+                return;
+            }
+            Section section;
+            section.name = trim(line.substr(1, close - 1));
+            this->sections.push_back(section);
+            return;
+        }
+        size_t equals = line.find('=');
+        if (equals == std::string::npos || equals == 0) {
+            fail(number, "expected key = value");
+            return;
+        }
+        std::string key = trim(line.substr(0, equals));
+        std::string value;
+        if (!parseValue(trim(line.substr(equals + 1)), value)) {
+            fail(number, "unterminated quote");
+            return;
+        }
+        this->sections.back().entries.emplace_back(key, value);
+    }
+
+    static bool parseValue(const std::string& text, std::string& value)
+    {
+        if (text.empty() || text[0] != '"') {
+            // an inline comment needs whitespace before it so values like a#b survive
+            size_t end = text.size();
+            for (size_t i = 1; i < text.size(); i++) {
+                if ((text[i] == ';' || text[i] == '#') && isspace((unsigned char)text[i - 1])) {
+                    end = i;
+                    break;
+                }
+            }
+            value = trim(text.substr(0, end));
+            return true;
+        }
+        for (size_t i = 1; i < text.size(); i++) {
+            char c = text[i];
+            if (c == '"') {
+                return true;
+            }
+            if (c == '\\' && i + 1 < text.size()) {
+                c = text[++i];
+                c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+            }
+            value += c;
+        }
+        return false;
+    }
+};
+
+} // namespace Utilis
+
+#endif // INI_READER_HPP
@@ -0,0 +1,223 @@
+#include "BinaryLog.hpp"
+#include <cstring>
+
+namespace {
+template <typename T>
+void put(LineBuffer& buffer, T value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool get(FILE* file, T& value)
+{
+    return fread(&value, sizeof(T), 1, file) == 1;
+}
+
+bool getString(FILE* file, std::string& value, size_t length)
+{
+    value.resize(length);
+    return length == 0 || fread(&value[0], 1, length, file) == length;
+}
+} // namespace
+
+#pragma region writer
+bool BinaryLogWriter::open(const std::string& fileName, bool deleteFile)
+{
+    close();
+    if (deleteFile) {
+        remove(fileName.c_str());
+    }
+    file = fopen(fileName.c_str(), "ab");
+    if (!file) {
+        return false;
+    }
+    // a fresh segment, call sites get re-announced
+    callSites.clear();
+    nextId = 0;
+    buffer.clear();
+    buffer.append(binaryLogMagic, sizeof(binaryLogMagic) - 1);
+    put<uint16_t>(buffer, binaryLogByteOrder);
+    fwrite(buffer.data, 1, buffer.size, file);
+    return true;
+}
+
+void BinaryLogWriter::close()
+{
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void BinaryLogWriter::flush()
+{
+    if (file) {
+        fflush(file);
+    }
+}
+
+uint32_t BinaryLogWriter::callSiteId(const std::experimental::source_location& location, const char* format)
+{
+    CallSiteKey key { location.file_name(), location.function_name(), format, (uint32_t)location.line(),
+        (uint32_t)location.column() };
+    auto found = callSites.find(key);
+    if (found != callSites.end()) {
+        return found->second;
+    }
+
+    uint32_t id = nextId++;
+    callSites.emplace(key, id);
+    uint16_t fileLength = (uint16_t)strnlen(key.file, UINT16_MAX);
+    uint16_t functionLength = (uint16_t)strnlen(key.function, UINT16_MAX);
+    uint32_t formatLength = format ? (uint32_t)strlen(format) : 0;
+
+    buffer.clear();
+    buffer.append('D');
+    put<uint32_t>(buffer, id);
+    put<uint32_t>(buffer, key.line);
+    put<uint32_t>(buffer, key.column);
+    put<uint8_t>(buffer, format ? 1 : 0);
+    put<uint16_t>(buffer, fileLength);
+    buffer.append(key.file, fileLength);
+    put<uint16_t>(buffer, functionLength);
+    buffer.append(key.function, functionLength);
+    put<uint32_t>(buffer, formatLength);
+    if (format) {
+        buffer.append(format, formatLength);
+    }
+    fwrite(buffer.data, 1, buffer.size, file);
+    return id;
+}
+
+void BinaryLogWriter::beginRecord(
+    uint32_t id, uint8_t level, uint8_t flags, int64_t timeNs, uint8_t argCount, uint32_t argsSize)
+{
+    buffer.clear();
+    buffer.append('R');
+    put<uint32_t>(buffer, id);
+    put<uint8_t>(buffer, level);
+    put<uint8_t>(buffer, flags);
+    put<int64_t>(buffer, timeNs);
+    put<uint8_t>(buffer, argCount);
+    put<uint32_t>(buffer, argsSize);
+}
+
+void BinaryLogWriter::write(uint8_t level, uint8_t flags, int64_t timeNs,
+    const std::experimental::source_location& location, const char* format, const uint8_t* args, size_t argsSize,
+    uint8_t argCount)
+{
+    if (!file) {
+        return;
+    }
+    uint32_t id = callSiteId(location, format);
+    beginRecord(id, level, flags, timeNs, argCount, (uint32_t)argsSize);
+    buffer.append(reinterpret_cast<const char*>(args), argsSize);
+    fwrite(buffer.data, 1, buffer.size, file);
+}
+
+void BinaryLogWriter::writeMessage(uint8_t level, uint8_t flags, int64_t timeNs,
+    const std::experimental::source_location& location, const char* message)
+{
+    if (!file) {
+        return;
+    }
+    uint32_t id = callSiteId(location, nullptr);
+    // same bytes LogArgs::addString() would produce
+    uint32_t length = (uint32_t)strlen(message);
+    beginRecord(id, level, flags, timeNs, 1, 1 + sizeof(length) + length);
+    put<uint8_t>(buffer, (uint8_t)LogArgs::Type::STRING);
+    put<uint32_t>(buffer, length);
+    buffer.append(message, length);
+    fwrite(buffer.data, 1, buffer.size, file);
+}
+#pragma endregion writer
+
+#pragma region reader
+BinaryLogReader::~BinaryLogReader()
+{
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool BinaryLogReader::open(const std::string& fileName)
+{
+    file = fopen(fileName.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char tag;
+    return get(file, tag) && tag == binaryLogMagic[0] && readHeader();
+}
+
+bool BinaryLogReader::readHeader()
+{
+    char magic[sizeof(binaryLogMagic) - 2];
+    uint16_t byteOrder;
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, binaryLogMagic + 1, sizeof(magic)) != 0
+        || !get(file, byteOrder) || byteOrder != binaryLogByteOrder) {
+        corrupt = true;
+        return false;
+    }
+    callSites.clear();
+    return true;
+}
+
+bool BinaryLogReader::readCallSite()
+{
+    uint32_t id;
+    uint8_t hasFormat;
+    uint16_t fileLength;
+    uint16_t functionLength;
+    uint32_t formatLength;
+    BinaryLogCallSite site;
+    if (!get(file, id) || !get(file, site.line) || !get(file, site.column) || !get(file, hasFormat)
+        || !get(file, fileLength) || !getString(file, site.file, fileLength) || !get(file, functionLength)
+        || !getString(file, site.function, functionLength) || !get(file, formatLength)
+        || !getString(file, site.format, formatLength) || id != callSites.size()) {
+        return false;
+    }
+    site.hasFormat = hasFormat != 0;
+    callSites.push_back(std::move(site));
+    return true;
+}
+
+bool BinaryLogReader::next(BinaryLogEntry& entry)
+{
+    if (!file || corrupt) {
+        return false;
+    }
+    char tag;
+    while (get(file, tag)) {
+        if (tag == 'D') {
+            if (!readCallSite()) {
+                break;
+            }
+            continue;
+        }
+        if (tag == binaryLogMagic[0]) {
+            if (!readHeader()) {
+                return false;
+            }
+            continue;
+        }
+        uint32_t id;
+        uint8_t argCount;
+        uint32_t argsSize;
+        if (tag != 'R' || !get(file, id) || !get(file, entry.level) || !get(file, entry.flags)
+            || !get(file, entry.timeNs) || !get(file, argCount) || !get(file, argsSize) || id >= callSites.size()) {
+            break;
+        }
+        args.resize(argsSize);
+        if (argsSize && fread(args.data(), 1, argsSize, file) != argsSize) {
+            break;
+        }
+        entry.callSite = &callSites[id];
+        entry.args.assign(args.data(), argsSize, argCount);
+        return true;
+    }
+    corrupt = !feof(file);
+    return false;
+}
+#pragma endregion reader
@@ -0,0 +1,143 @@
+#ifndef BINARY_LOG_HPP
+#define BINARY_LOG_HPP
+
+#include "LineBuffer.hpp"
+#include "LogFormat.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <experimental/source_location>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary log file used by the LOG_BINARY target, turned back into text by utilis-logdecode.
+//
+// Layout (native byte order, read back on the same architecture):
+//   header      "ULOGBIN1" u16 0x0102
+//   dictionary  'D' u32 id, u32 line, u32 column, u8 hasFormat,
+//               u16 fileLength file, u16 functionLength function, u32 formatLength format
+//   record      'R' u32 id, u8 level, u8 flags, i64 time (ns, see Logger::timestampNow()),
+//               u8 argCount, u32 argsSize, packed LogArgs
+// A dictionary entry is written the first time a call site logs, records only reference its id.
+// Plain (non format) messages are stored as one string argument of a call site without a format.
+// A file may contain several header+dictionary segments (one per open), ids restart with each one.
+#define binaryLogMagic "ULOGBIN1"
+#define binaryLogByteOrder 0x0102
+
+// Copies of Logger style flags, stored per record so the decoder reproduces the exact layout.
+// Bits 3-4 hold the TimestampPrecision and bits 5-6 the TimestampMode.
+enum BinaryLogFlags : uint8_t { BINARY_TIMESTAMP = 1,
+    BINARY_LEVEL = 2,
+    BINARY_FILE_INFO = 4,
+    BINARY_PRECISION_SHIFT = 3,
+    BINARY_PRECISION_MASK = 0x18,
+    BINARY_MODE_SHIFT = 5,
+    BINARY_MODE_MASK = 0x60 };
+
+class BinaryLogWriter {
+public:
+    BinaryLogWriter() = default;
+    BinaryLogWriter(const BinaryLogWriter&) = delete;
+    BinaryLogWriter& operator=(const BinaryLogWriter&) = delete;
+    ~BinaryLogWriter() { close(); }
+
+    /* Open (append) a binary log file and start a new segment.
+     *
+     * \param	string	File to write to
+     * \param	bool	Remove an existing file first
+     * \return	bool	false if the file could not be opened
+     */
+    bool open(const std::string& fileName, bool deleteFile = false);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+    void flush();
+
+    /* Append a format call record. Not thread safe, the Logger serializes calls.
+     */
+    void write(uint8_t level, uint8_t flags, int64_t timeNs, const std::experimental::source_location& location,
+        const char* format, const uint8_t* args, size_t argsSize, uint8_t argCount);
+
+    /* Append a plain message record.
+     */
+    void writeMessage(uint8_t level, uint8_t flags, int64_t timeNs, const std::experimental::source_location& location,
+        const char* message);
+
+private:
+    struct CallSiteKey {
+        const char* file;
+        const char* function;
+        const char* format;
+        uint32_t line;
+        uint32_t column;
+        bool operator==(const CallSiteKey& other) const
+        {
+            return file == other.file && function == other.function && format == other.format && line == other.line
+                && column == other.column;
+        }
+    };
+    struct CallSiteHash {
+        size_t operator()(const CallSiteKey& key) const
+        {
+            size_t hash = std::hash<const void*>()(key.file);
+            hash ^= std::hash<const void*>()(key.format) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            hash ^= (size_t)key.line * 31 + key.column + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            return hash;
+        }
+    };
+
+    FILE* file = nullptr;
+    std::unordered_map<CallSiteKey, uint32_t, CallSiteHash> callSites;
+    uint32_t nextId = 0;
+    LineBuffer buffer;
+
+    uint32_t callSiteId(const std::experimental::source_location& location, const char* format);
+    void beginRecord(uint32_t id, uint8_t level, uint8_t flags, int64_t timeNs, uint8_t argCount, uint32_t argsSize);
+};
+
+// Static part of a call site as read back from the dictionary.
+struct BinaryLogCallSite {
+    uint32_t line = 0;
+    uint32_t column = 0;
+    bool hasFormat = false;
+    std::string file;
+    std::string function;
+    std::string format;
+};
+
+struct BinaryLogEntry {
+    uint8_t level = 0;
+    uint8_t flags = 0;
+    int64_t timeNs = 0;
+    const BinaryLogCallSite* callSite = nullptr;
+    LogArgs args;
+};
+
+class BinaryLogReader {
+public:
+    BinaryLogReader() = default;
+    BinaryLogReader(const BinaryLogReader&) = delete;
+    BinaryLogReader& operator=(const BinaryLogReader&) = delete;
+    ~BinaryLogReader();
+
+    bool open(const std::string& fileName);
+
+    /* Read the next record, dictionary entries and segment headers are consumed on the way.
+     *
+     * \param	BinaryLogEntry	Receives the record, valid until the next call
+     * \return	bool	false at the end of the file or on a malformed file (see isCorrupt())
+     */
+    bool next(BinaryLogEntry& entry);
+
+    bool isCorrupt() const { return corrupt; }
+
+private:
+    FILE* file = nullptr;
+    std::vector<BinaryLogCallSite> callSites;
+    std::vector<uint8_t> args;
+    bool corrupt = false;
+
+    bool readHeader();
+    bool readCallSite();
+};
+
+#endif // BINARY_LOG_HPP
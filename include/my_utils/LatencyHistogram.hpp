@@ -0,0 +1,92 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram of nanosecond latencies: 8 buckets per power of two, so any percentile is
+// within 12.5% of the recorded value. Fixed size, recording never allocates. Not thread safe.
+class LatencyHistogram {
+public:
+#define latencyHistogramSubBuckets 8
+#define latencyHistogramBuckets ((64 - 3 + 1) * latencyHistogramSubBuckets)
+
+    void record(uint64_t nanoseconds)
+    {
+        this->buckets[bucketOf(nanoseconds)]++;
+        this->total++;
+        this->sum += nanoseconds;
+        if (nanoseconds > this->maximum) {
+            this->maximum = nanoseconds;
+        }
+    }
+
+    /* \param	double	Percentile between 0 and 100
+     * \return	uint64_t	Upper bound of the bucket holding it, 0 if nothing was recorded
+     */
+    uint64_t percentile(double percent) const
+    {
+        if (this->total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(percent / 100.0 * (double)this->total);
+        if (rank >= this->total) {
+            rank = this->total - 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < latencyHistogramBuckets; i++) {
+            seen += this->buckets[i];
+            if (seen > rank) {
+                uint64_t bound = upperBound(i);
+                return bound < this->maximum ? bound : this->maximum;
+            }
+        }
+        return this->maximum;
+    }
+
+    uint64_t count() const { return this->total; }
+    uint64_t max() const { return this->maximum; }
+    double mean() const { return this->total ? (double)this->sum / (double)this->total : 0.0; }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < latencyHistogramBuckets; i++) {
+            this->buckets[i] += other.buckets[i];
+        }
+        this->total += other.total;
+        this->sum += other.sum;
+        if (other.maximum > this->maximum) {
+            this->maximum = other.maximum;
+        }
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+private:
+    uint64_t buckets[latencyHistogramBuckets] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maximum = 0;
+
+    // values below 8 get a bucket each, above that the top 3 bits after the leading one pick the sub bucket
+    static size_t bucketOf(uint64_t value)
+    {
+        if (value < latencyHistogramSubBuckets) {
+            return (size_t)value;
+        }
+        unsigned int exponent = 63 - (unsigned int)__builtin_clzll(value);
+        return (exponent - 2) * latencyHistogramSubBuckets + ((value >> (exponent - 3)) & 7);
+    }
+
+    static uint64_t upperBound(size_t bucket)
+    {
+        if (bucket < latencyHistogramSubBuckets) {
+            return bucket;
+        }
+        unsigned int exponent = (unsigned int)(bucket / latencyHistogramSubBuckets) + 2;
+        uint64_t lower = (uint64_t)(latencyHistogramSubBuckets + bucket % latencyHistogramSubBuckets) << (exponent - 3);
+        return lower + ((uint64_t)1 << (exponent - 3)) - 1;
+    }
+};
+
+#endif // LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,121 @@
+#ifndef LINE_BUFFER_HPP
+#define LINE_BUFFER_HPP
+
+#include "LogAlloc.hpp"
+#include "NumberFormat.hpp"
+#include <cstdlib>
+#include <cstring>
+
+// Growable scratch buffer used to assemble log lines.
+// The Logger keeps one per thread so formatting never shares state between callers.
+// In the fixed capacity mode (Logger::setFixedCapacity()) a buffer is allocated once and appends that don't fit
+// are cut off instead of growing it.
+struct LineBuffer {
+#define lineBufferStartSize 512
+    char* data = nullptr;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    LineBuffer() = default;
+    LineBuffer(const LineBuffer&) = delete;
+    LineBuffer& operator=(const LineBuffer&) = delete;
+    LineBuffer(LineBuffer&& other) noexcept
+        : data(other.data)
+        , size(other.size)
+        , capacity(other.capacity)
+    {
+        other.data = nullptr;
+        other.size = other.capacity = 0;
+    }
+    LineBuffer& operator=(LineBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            logFree(data, capacity);
+            data = other.data;
+            size = other.size;
+            capacity = other.capacity;
+            other.data = nullptr;
+            other.size = other.capacity = 0;
+        }
+        return *this;
+    }
+    ~LineBuffer() { logFree(data, capacity); }
+
+    void clear() { size = 0; }
+
+    /* Make sure there is room for at least `extra` more bytes plus a terminating 0.
+     *
+     * \param	size_t	Number of bytes about to be appended
+     * \return	size_t	How many of them fit, less than extra only if the buffer is fixed and full
+     */
+    size_t reserve(size_t extra)
+    {
+        size_t needed = size + extra + 1;
+        if (needed <= capacity) {
+            return extra;
+        }
+        size_t fixed = logFixedCapacity.load(std::memory_order_relaxed);
+        if (fixed) {
+            // grown once to the fixed capacity, never beyond it
+            if (capacity < fixed) {
+                data = (char*)logRealloc(data, capacity, fixed);
+                capacity = fixed;
+            }
+            if (needed <= capacity) {
+                return extra;
+            }
+            logAllocTruncated();
+            return capacity - size - 1;
+        }
+        size_t newCapacity = capacity ? capacity : lineBufferStartSize;
+        while (newCapacity < needed) {
+            newCapacity *= 2;
+        }
+        data = (char*)logRealloc(data, capacity, sizeof(char) * newCapacity);
+        capacity = newCapacity;
+        return extra;
+    }
+
+    /* Empty the buffer and allocate it now: the fixed capacity if it is set, the start size otherwise.
+     */
+    void preallocate()
+    {
+        clear();
+        size_t fixed = logFixedCapacity.load(std::memory_order_relaxed);
+        reserve(fixed ? fixed - 1 : 0);
+    }
+
+    void append(const char* src, size_t length)
+    {
+        length = reserve(length);
+        memcpy(data + size, src, length);
+        size += length;
+        data[size] = '\0';
+    }
+
+    void append(const char* src) { append(src, strlen(src)); }
+
+    void append(char c)
+    {
+        if (reserve(1)) {
+            data[size++] = c;
+            data[size] = '\0';
+        }
+    }
+
+    // unsigned decimal, no allocation
+    void append(unsigned int value)
+    {
+        if (reserve(numberFormatMaxChars) < numberFormatMaxChars) {
+            char text[numberFormatMaxChars];
+            append(text, formatUnsigned(text, value));
+            return;
+        }
+        size += formatUnsigned(data + size, value);
+        data[size] = '\0';
+    }
+
+    const char* c_str() const { return data ? data : ""; }
+};
+
+#endif // LINE_BUFFER_HPP
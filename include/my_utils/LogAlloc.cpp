@@ -0,0 +1,53 @@
+#include "LogAlloc.hpp"
+
+std::atomic<bool> logAllocAudit { false };
+std::atomic<size_t> logFixedCapacity { 0 };
+
+namespace {
+std::atomic<uint64_t> allocations { 0 };
+std::atomic<uint64_t> frees { 0 };
+std::atomic<uint64_t> bytesAllocated { 0 };
+std::atomic<int64_t> liveBytes { 0 };
+std::atomic<int64_t> peakLiveBytes { 0 };
+std::atomic<uint64_t> truncations { 0 };
+} // namespace
+
+void logAllocCount(size_t oldSize, size_t newSize)
+{
+    if (newSize == 0) {
+        frees.fetch_add(1, std::memory_order_relaxed);
+        liveBytes.fetch_sub((int64_t)oldSize, std::memory_order_relaxed);
+        return;
+    }
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytesAllocated.fetch_add(newSize > oldSize ? newSize - oldSize : 0, std::memory_order_relaxed);
+    int64_t live = liveBytes.fetch_add((int64_t)newSize - (int64_t)oldSize, std::memory_order_relaxed)
+        + (int64_t)newSize - (int64_t)oldSize;
+    int64_t peak = peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void logAllocTruncated() { truncations.fetch_add(1, std::memory_order_relaxed); }
+
+LogAllocStats getLogAllocStats()
+{
+    LogAllocStats stats;
+    stats.allocations = allocations.load(std::memory_order_relaxed);
+    stats.frees = frees.load(std::memory_order_relaxed);
+    stats.bytesAllocated = bytesAllocated.load(std::memory_order_relaxed);
+    stats.liveBytes = liveBytes.load(std::memory_order_relaxed);
+    stats.peakLiveBytes = peakLiveBytes.load(std::memory_order_relaxed);
+    stats.truncations = truncations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void resetLogAllocStats()
+{
+    allocations = 0;
+    frees = 0;
+    bytesAllocated = 0;
+    liveBytes = 0;
+    peakLiveBytes = 0;
+    truncations = 0;
+}
@@ -0,0 +1,56 @@
+#ifndef LOG_ALLOC_HPP
+#define LOG_ALLOC_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+// Heap memory taken by the Logger's internals: line buffers, argument buffers, file buffers, call sites and
+// staging buffers all allocate through logMalloc()/logRealloc()/logFree(). Process wide, shared by all Loggers.
+// Counting starts with Logger::enableAllocationAudit(), memory allocated before and freed after makes liveBytes
+// negative.
+struct LogAllocStats {
+    uint64_t allocations = 0; // malloc and realloc calls
+    uint64_t frees = 0;
+    uint64_t bytesAllocated = 0; // bytes asked for, a realloc counts its growth
+    int64_t liveBytes = 0; // allocated minus freed
+    int64_t peakLiveBytes = 0;
+    uint64_t truncations = 0; // appends cut short in the fixed capacity mode, counted even without the audit
+};
+
+// Set by Logger::enableAllocationAudit()
+extern std::atomic<bool> logAllocAudit;
+// Set by Logger::setFixedCapacity(), 0 while buffers may grow
+extern std::atomic<size_t> logFixedCapacity;
+
+void logAllocCount(size_t oldSize, size_t newSize);
+void logAllocTruncated();
+LogAllocStats getLogAllocStats();
+void resetLogAllocStats();
+
+inline void* logMalloc(size_t size)
+{
+    if (logAllocAudit.load(std::memory_order_relaxed)) {
+        logAllocCount(0, size);
+    }
+    return malloc(size);
+}
+
+inline void* logRealloc(void* data, size_t oldSize, size_t newSize)
+{
+    if (logAllocAudit.load(std::memory_order_relaxed)) {
+        logAllocCount(oldSize, newSize);
+    }
+    return realloc(data, newSize);
+}
+
+inline void logFree(void* data, size_t size)
+{
+    if (data && logAllocAudit.load(std::memory_order_relaxed)) {
+        logAllocCount(size, 0);
+    }
+    free(data);
+}
+
+#endif // LOG_ALLOC_HPP
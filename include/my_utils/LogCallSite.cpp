@@ -0,0 +1,87 @@
+#include "LogCallSite.hpp"
+#include "LogAlloc.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+// Open addressing with linear probing. Slots only ever go from empty to a descriptor, so a reader that
+// finds an empty slot knows the site isn't registered yet.
+std::atomic<const LogCallSite*> callSiteTable[logCallSiteTableSize];
+
+bool sameSite(const LogCallSite* site, const std::experimental::source_location& location)
+{
+    return site->file == location.file_name() && site->line == location.line()
+        && site->column == location.column() && site->function == location.function_name();
+}
+
+size_t callSiteHash(const std::experimental::source_location& location)
+{
+    uint64_t hash = (uint64_t)(uintptr_t)location.file_name() ^ ((uint64_t)location.line() << 16) ^ location.column();
+    hash *= 0x9E3779B97F4A7C15ull;
+    return (size_t)(hash >> 32);
+}
+
+LogCallSite* makeCallSite(const std::experimental::source_location& location)
+{
+    LineBuffer prefix;
+    appendCallSite(prefix, location);
+    // descriptor and prefix in one block
+    char* block = (char*)logMalloc(sizeof(LogCallSite) + prefix.size + 1);
+    LogCallSite* site = new (block) LogCallSite;
+    char* text = block + sizeof(LogCallSite);
+    memcpy(text, prefix.data, prefix.size + 1);
+
+    const char* file = location.file_name();
+    const char* slash = strrchr(file, '/');
+    site->file = file;
+    site->baseName = slash ? slash + 1 : file;
+    site->function = location.function_name();
+    site->line = location.line();
+    site->column = location.column();
+    site->prefix = text;
+    site->prefixLength = prefix.size;
+    return site;
+}
+} // namespace
+
+const LogCallSite* logCallSite(const std::experimental::source_location& location)
+{
+    size_t index = callSiteHash(location);
+    LogCallSite* created = nullptr;
+    for (size_t probe = 0; probe < logCallSiteTableSize; probe++) {
+        std::atomic<const LogCallSite*>& slot = callSiteTable[(index + probe) & (logCallSiteTableSize - 1)];
+        const LogCallSite* site = slot.load(std::memory_order_acquire);
+        if (site == nullptr) {
+            if (!created) {
+                created = makeCallSite(location);
+            }
+            // not published yet, nobody else can see the descriptor
+            created->slot = (uint32_t)((index + probe) & (logCallSiteTableSize - 1));
+            if (slot.compare_exchange_strong(site, created, std::memory_order_acq_rel)) {
+                return created;
+            }
+            // another thread claimed the slot first, site now holds its descriptor
+        }
+        if (sameSite(site, location)) {
+            logFree((void*)created, created ? sizeof(LogCallSite) + created->prefixLength + 1 : 0);
+            return site;
+        }
+    }
+    logFree((void*)created, created ? sizeof(LogCallSite) + created->prefixLength + 1 : 0);
+    return nullptr;
+}
+
+const LogCallSite* logCallSiteAt(size_t slot) { return callSiteTable[slot].load(std::memory_order_acquire); }
+
+void appendCallSite(LineBuffer& out, const std::experimental::source_location& location)
+{
+    out.append(location.file_name());
+    out.append(':');
+    out.append((unsigned int)location.line());
+    out.append(';');
+    out.append((unsigned int)location.column());
+    out.append("  ", 2);
+    out.append(location.function_name());
+}
@@ -0,0 +1,47 @@
+#ifndef LOG_CALL_SITE_HPP
+#define LOG_CALL_SITE_HPP
+
+#include "LineBuffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <experimental/source_location>
+
+// Static description of one logging call site, built the first time the site logs.
+// The file info part of the text line is rendered once and copied from here on every call after that.
+struct LogCallSite {
+    const char* file;
+    const char* baseName; // file without its directories
+    const char* function;
+    uint32_t line;
+    uint32_t column;
+    // "file:line;column  function", 0 terminated
+    const char* prefix;
+    size_t prefixLength;
+    // index in the call site table, Loggers keep their per site state in arrays of logCallSiteTableSize
+    uint32_t slot;
+};
+
+// Slots in the call site table, sites beyond it are rendered on every call.
+#define logCallSiteTableSize 4096
+
+/* Find the descriptor of a call site, registering it on first use. Lock free, the only allocation is
+ * the descriptor itself, once per site (descriptors live as long as the process). Sites are keyed by
+ * their file and function pointers, so the location must come from source_location::current() literals.
+ *
+ * \param	location	The call site, as captured by a source_location default argument
+ * \return	LogCallSite	The descriptor, nullptr if the table is full
+ */
+const LogCallSite* logCallSite(const std::experimental::source_location& location);
+
+/* Descriptor in a slot of the table, to walk all registered sites.
+ *
+ * \param	size_t	Slot index, below logCallSiteTableSize
+ * \return	LogCallSite	The descriptor, nullptr for an empty slot
+ */
+const LogCallSite* logCallSiteAt(size_t slot);
+
+/* Append "file:line;column  function" for a location without going through the table.
+ */
+void appendCallSite(LineBuffer& out, const std::experimental::source_location& location);
+
+#endif // LOG_CALL_SITE_HPP
@@ -0,0 +1,237 @@
+#include "LogFile.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+LogFile::~LogFile()
+{
+    close();
+    logFree(buffer, capacity);
+}
+
+bool LogFile::open(const std::string& fileName, std::ios_base::openmode mode)
+{
+    close();
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    flags |= (mode & std::ios_base::app) ? O_APPEND : O_TRUNC;
+    descriptor = ::open(fileName.c_str(), flags, 0666);
+    unsynced = 0;
+    owned = true;
+    if (descriptor >= 0 && uring) {
+        useOffsets();
+    }
+    return descriptor >= 0;
+}
+
+void LogFile::useOffsets()
+{
+    // writes in flight complete in any order, each needs its own place in the file
+    fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) & ~O_APPEND);
+    off_t end = lseek(descriptor, 0, SEEK_END);
+    offset = end < 0 ? 0 : (uint64_t)end;
+}
+
+bool LogFile::setUring(unsigned int depth)
+{
+    flush();
+    if (uring) {
+        uring->drain();
+    }
+    if (depth == 0) {
+        uring.reset();
+        if (descriptor >= 0 && owned) {
+            fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) | O_APPEND);
+        }
+        return false;
+    }
+    uring = std::make_unique<LogUring>(depth);
+    if (descriptor >= 0) {
+        useOffsets();
+    }
+    return uring->isKernelRing();
+}
+
+void LogFile::attach(int fd)
+{
+    close();
+    descriptor = fd;
+    unsynced = 0;
+    owned = false;
+}
+
+void LogFile::close()
+{
+    if (descriptor < 0) {
+        return;
+    }
+    flush();
+    if (uring) {
+        uring->drain();
+    }
+    if (owned) {
+        ::close(descriptor);
+    }
+    descriptor = -1;
+}
+
+bool LogFile::writeAll(const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = ::write(descriptor, data, size);
+        counters.writeCalls++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        counters.bytesWritten += (uint64_t)written;
+        unsynced += (uint64_t)written;
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+bool LogFile::writevAll(struct iovec* parts, int count)
+{
+    while (count > 0) {
+        ssize_t written = ::writev(descriptor, parts, count);
+        counters.writeCalls++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        counters.bytesWritten += (uint64_t)written;
+        unsynced += (uint64_t)written;
+        // skip what was written, a short write can end in the middle of a piece
+        while (count > 0 && (size_t)written >= parts->iov_len) {
+            written -= (ssize_t)parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = (char*)parts->iov_base + written;
+            parts->iov_len -= (size_t)written;
+        }
+    }
+    return true;
+}
+
+void LogFile::write(const char* data, size_t size)
+{
+    if (descriptor < 0) {
+        return;
+    }
+    if (used + size > capacity) {
+        if (size >= capacity && uring) {
+            // buffers are handed over whole, big writes go through them in pieces
+            while (size > 0) {
+                if (used == capacity) {
+                    flush();
+                }
+                size_t piece = std::min(size, capacity - used);
+                write(data, piece);
+                data += piece;
+                size -= piece;
+            }
+            return;
+        }
+        if (size >= capacity) {
+            // too big to be worth copying, goes out together with the buffer
+            struct iovec parts[2] = { { buffer, used }, { const_cast<char*>(data), size } };
+            counters.flushes++;
+            if (used) {
+                writevAll(parts, 2);
+            } else {
+                writeAll(data, size);
+            }
+            used = 0;
+            return;
+        }
+        flush();
+    }
+    allocateBuffer();
+    memcpy(buffer + used, data, size);
+    used += size;
+}
+
+bool LogFile::flush()
+{
+    if (descriptor < 0 || used == 0) {
+        return true;
+    }
+    counters.flushes++;
+    if (uring) {
+        // errors only show up in the uring's counters
+        counters.bytesWritten += used;
+        unsynced += used;
+        buffer = uring->submit(descriptor, buffer, used, offset, capacity);
+        offset += used;
+        used = 0;
+        return true;
+    }
+    bool ok = writeAll(buffer, used);
+    used = 0;
+    return ok;
+}
+
+void LogFile::flushFromSignal()
+{
+    size_t pending = used;
+    used = 0;
+    if (buffer && pending) {
+        writeFromSignal(buffer, pending);
+    }
+}
+
+void LogFile::writeFromSignal(const char* data, size_t size)
+{
+    if (descriptor < 0) {
+        return;
+    }
+    while (size > 0) {
+        // with uring the kernel may still be writing earlier buffers, our place comes after them
+        ssize_t written = uring ? ::pwrite(descriptor, data, size, (off_t)offset) : ::write(descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (uring) {
+            offset += (uint64_t)written;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+bool LogFile::sync()
+{
+    if (descriptor < 0) {
+        return true;
+    }
+    if (uring) {
+        uring->drain();
+    }
+    counters.syncCalls++;
+    if (fsync(descriptor) != 0) {
+        return false;
+    }
+    unsynced = 0;
+    return true;
+}
+
+void LogFile::setBufferSize(size_t size)
+{
+    flush();
+    logFree(buffer, capacity);
+    buffer = nullptr;
+    capacity = size ? size : 1;
+}
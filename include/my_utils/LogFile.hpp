@@ -0,0 +1,126 @@
+#ifndef LOG_FILE_HPP
+#define LOG_FILE_HPP
+
+#include "LogAlloc.hpp"
+#include "LogUring.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+
+// Syscall counters of a LogFile, for tuning the flush policy.
+struct LogFileStats {
+    uint64_t writeCalls = 0; // write(2)/writev(2) syscalls
+    uint64_t flushes = 0; // flushes that had something to write
+    uint64_t bytesWritten = 0;
+    uint64_t syncCalls = 0; // fsync(2) syscalls
+
+    double bytesPerFlush() const { return flushes ? (double)bytesWritten / (double)flushes : 0.0; }
+};
+
+// Buffered file descriptor used by the LOG_FILE, STDOUT and STDERR targets in place of std::ofstream and stdio,
+// so the Logger decides when data hits write(2) and can fsync it.
+// Keeps the is_open()/open()/close()/write()/flush() shape of the ofstream it replaced. Not thread safe.
+class LogFile {
+public:
+#define logFileDefaultBufferSize (64 * 1024)
+    LogFile() = default;
+    LogFile(const LogFile&) = delete;
+    LogFile& operator=(const LogFile&) = delete;
+    ~LogFile();
+
+    /* Open a file for writing, flushing and closing the previous one.
+     *
+     * \param	string	File name
+     * \param	openmode	ios::app appends, anything else truncates like std::ofstream
+     * \return	bool	false if the file could not be opened
+     */
+    bool open(const std::string& fileName, std::ios_base::openmode mode = std::ios_base::app);
+    bool is_open() const { return descriptor >= 0; }
+    void close();
+
+    /* Write to a descriptor owned by someone else (stdout, stderr), close() only flushes it.
+     *
+     * \param	int	The file descriptor
+     */
+    void attach(int fd);
+
+    /* Buffer data, anything that does not fit the buffer is written right away
+     * together with what was buffered, in one writev(2).
+     */
+    void write(const char* data, size_t size);
+
+    /* write(2) everything buffered.
+     *
+     * \return	bool	false if the write failed
+     */
+    bool flush();
+
+    /* fsync(2) the file, call flush() first.
+     */
+    bool sync();
+
+    /* Bytes handed to the kernel since the last sync(), including writes too big for the buffer
+     * that went out directly.
+     */
+    uint64_t unsyncedBytes() const { return unsynced; }
+
+    /* Write what is buffered, then data, with nothing but write(2)/pwrite(2): no counters, no io_uring calls.
+     * For the crash handler, may be called while another thread is inside write().
+     */
+    void flushFromSignal();
+    void writeFromSignal(const char* data, size_t size);
+
+    /* Hand full buffers to an io_uring instead of write(2), see LogUring. Writes then go to explicit offsets
+     * instead of O_APPEND, so the file must not be appended to by anyone else meanwhile.
+     *
+     * \param	unsigned	Writes in flight, 0 goes back to write(2)
+     * \return	bool	true if the kernel ring is used, false if it falls back to pwrite(2)
+     */
+    bool setUring(unsigned int depth);
+
+    /* The io_uring backend, nullptr if setUring() wasn't called.
+     */
+    const LogUring* uringBackend() const { return uring.get(); }
+
+    /* Change the buffer size, flushes what is buffered.
+     *
+     * \param	size_t	New buffer size in bytes
+     */
+    void setBufferSize(size_t size);
+
+    /* Allocate the buffer now instead of at the first write, for the fixed capacity mode.
+     */
+    void allocateBuffer()
+    {
+        if (!buffer) {
+            buffer = (char*)logMalloc(capacity);
+        }
+    }
+
+    size_t buffered() const { return used; }
+    size_t bufferSize() const { return capacity; }
+    int fd() const { return descriptor; }
+    const LogFileStats& stats() const { return counters; }
+    void resetStats() { counters = LogFileStats(); }
+
+private:
+    int descriptor = -1;
+    bool owned = true;
+    std::unique_ptr<LogUring> uring;
+    // next write position while uring is set
+    uint64_t offset = 0;
+    char* buffer = nullptr;
+    size_t used = 0;
+    size_t capacity = logFileDefaultBufferSize;
+    uint64_t unsynced = 0;
+    LogFileStats counters;
+
+    bool writeAll(const char* data, size_t size);
+    bool writevAll(struct iovec* parts, int count);
+    void useOffsets();
+};
+
+#endif // LOG_FILE_HPP
@@ -0,0 +1,88 @@
+#include "LogFlightRecorder.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+LogFlightRecorder::LogFlightRecorder(size_t memoryBudget)
+{
+    size_t count = 1;
+    while (count * 2 * sizeof(Slot) <= memoryBudget) {
+        count *= 2;
+    }
+    this->slots.reset(new Slot[count]);
+    this->mask = count - 1;
+}
+
+void LogFlightRecorder::record(Level level, int64_t time, const std::experimental::source_location& location,
+    const char* message, const char* format, const LogArgs* args, const char* category)
+{
+    uint64_t ticket = this->head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = this->slots[ticket & this->mask];
+    uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    // a writer a full lap behind is still busy here (or a newer one already was), drop rather than wait
+    if ((sequence & 1) || sequence > ticket * 2
+        || !slot.sequence.compare_exchange_strong(sequence, ticket * 2 + 1, std::memory_order_acquire)) {
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogFlightRecord& record = slot.record;
+    record.time = time;
+    record.location = location;
+    record.level = (uint8_t)level;
+    record.category = category;
+    if (format) {
+        record.format = format;
+        // arguments that don't fit are left out, their placeholders print as "{}"
+        if (args->size() <= flightRecorderPayloadSize) {
+            memcpy(record.payload, args->data(), args->size());
+            record.size = (uint16_t)args->size();
+            record.argCount = args->count();
+        } else {
+            record.size = 0;
+            record.argCount = 0;
+        }
+    } else {
+        record.format = nullptr;
+        record.argCount = 0;
+        size_t length = strnlen(message, flightRecorderPayloadSize);
+        if (length == flightRecorderPayloadSize) {
+            length = flightRecorderPayloadSize - 1;
+            memcpy(record.payload, message, length - 3);
+            memcpy(record.payload + length - 3, "...", 3);
+        } else {
+            memcpy(record.payload, message, length);
+        }
+        record.payload[length] = '\0';
+        record.size = (uint16_t)(length + 1);
+    }
+    slot.sequence.store(ticket * 2 + 2, std::memory_order_release);
+}
+
+bool LogFlightRecorder::claim(size_t maxCount, uint64_t& start, uint64_t& end)
+{
+    end = this->head.load(std::memory_order_acquire);
+    uint64_t from = this->drained.load(std::memory_order_relaxed);
+    // concurrent drains split the range instead of printing records twice
+    do {
+        if (from >= end) {
+            return false;
+        }
+    } while (!this->drained.compare_exchange_weak(from, end, std::memory_order_relaxed));
+    uint64_t window = std::min<uint64_t>(maxCount, this->capacity());
+    start = std::max(from, end > window ? end - window : 0);
+    return true;
+}
+
+bool LogFlightRecorder::read(uint64_t ticket, LogFlightRecord& out) const
+{
+    const Slot& slot = this->slots[ticket & this->mask];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != ticket * 2 + 2) {
+        return false;
+    }
+    memcpy(static_cast<void*>(&out), &slot.record, offsetof(LogFlightRecord, payload));
+    memcpy(out.payload, slot.record.payload, std::min<size_t>(out.size, flightRecorderPayloadSize));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == sequence;
+}
@@ -0,0 +1,103 @@
+#ifndef LOG_FLIGHT_RECORDER_HPP
+#define LOG_FLIGHT_RECORDER_HPP
+
+#include "LogFormat.hpp"
+#include "LogLevel.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <experimental/source_location>
+#include <memory>
+
+// Fixed size slots, a record is cut down to fit.
+#define flightRecorderSlotSize 256
+#define flightRecorderPayloadSize 192
+
+// One captured call, unformatted. The payload holds the packed LogArgs of a format call
+// or the 0 terminated message of a plain one.
+struct LogFlightRecord {
+    int64_t time = 0;
+    std::experimental::source_location location;
+    const char* format = nullptr;
+    const char* category = nullptr;
+    uint8_t level = 0;
+    uint8_t argCount = 0;
+    uint16_t size = 0;
+    uint8_t payload[flightRecorderPayloadSize];
+};
+
+// Ring of the most recent records below the logging level, kept so they can be written out once something
+// goes wrong. All memory is allocated by the constructor, recording is lock free and never allocates.
+// Writers claim slots with a ticket counter; readers copy a slot and check its sequence number to skip
+// slots that were overwritten meanwhile.
+class LogFlightRecorder {
+public:
+    /* \param	size_t	Memory budget in bytes, rounded down to a power of two number of slots
+     */
+    explicit LogFlightRecorder(size_t memoryBudget);
+    LogFlightRecorder(const LogFlightRecorder&) = delete;
+    LogFlightRecorder& operator=(const LogFlightRecorder&) = delete;
+
+    /* Capture a call. Format strings must outlive the recorder (string literals).
+     *
+     * \param	Level	The severity of the message
+     * \param	int64_t	Timestamp, see Logger::timestampNow()
+     * \param	location	Call site
+     * \param	char*	Message of a plain call, ignored if format is set
+     * \param	char*	Format string of a format call
+     * \param	LogArgs	Arguments of a format call
+     * \param	char*	Category name (must outlive the recorder), nullptr for none
+     */
+    void record(Level level, int64_t time, const std::experimental::source_location& location, const char* message,
+        const char* format, const LogArgs* args, const char* category = nullptr);
+
+    /* Hand the most recent records that weren't drained before to a callback, oldest first.
+     *
+     * \param	size_t	Maximum number of records
+     * \param	Callback	Called with each LogFlightRecord
+     * \return	size_t	Number of records passed to the callback
+     */
+    template <typename Callback>
+    size_t drain(size_t maxCount, Callback&& callback)
+    {
+        uint64_t start;
+        uint64_t end;
+        if (!claim(maxCount, start, end)) {
+            return 0;
+        }
+        LogFlightRecord record;
+        size_t count = 0;
+        for (uint64_t ticket = start; ticket < end; ticket++) {
+            if (read(ticket, record)) {
+                callback(record);
+                count++;
+            }
+        }
+        return count;
+    }
+
+    size_t capacity() const { return this->mask + 1; }
+
+    /* Records lost because a writer was still busy in the slot they were assigned.
+     */
+    uint64_t getDroppedCount() const { return this->dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Slot {
+        // 2 * ticket + 1 while the record is written, 2 * ticket + 2 once complete
+        std::atomic<uint64_t> sequence { 0 };
+        LogFlightRecord record;
+    };
+    static_assert(sizeof(Slot) <= flightRecorderSlotSize, "flight recorder slot header grew");
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    alignas(64) std::atomic<uint64_t> head { 0 };
+    alignas(64) std::atomic<uint64_t> drained { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+
+    bool claim(size_t maxCount, uint64_t& start, uint64_t& end);
+    bool read(uint64_t ticket, LogFlightRecord& out) const;
+};
+
+#endif // LOG_FLIGHT_RECORDER_HPP
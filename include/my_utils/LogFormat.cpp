@@ -0,0 +1,241 @@
+#include "LogFormat.hpp"
+#include "NumberFormat.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+LogArgs::LogArgs(LogArgs&& other) noexcept { *this = std::move(other); }
+
+LogArgs& LogArgs::operator=(LogArgs&& other) noexcept
+{
+    if (this == &other) {
+        return *this;
+    }
+    logFree(heapData, capacity);
+    heapData = nullptr;
+    capacity = logArgsInlineSize;
+    if (other.heapData) {
+        // steal the heap block, the other side falls back to its inline storage
+        heapData = other.heapData;
+        capacity = other.capacity;
+        other.heapData = nullptr;
+        other.capacity = logArgsInlineSize;
+    } else {
+        memcpy(inlineData, other.inlineData, other.used);
+    }
+    used = other.used;
+    argCount = other.argCount;
+    other.clear();
+    return *this;
+}
+
+uint8_t* LogArgs::reserve(size_t extra)
+{
+    if (used + extra > capacity) {
+        size_t newCapacity = capacity * 2;
+        while (newCapacity < used + extra) {
+            newCapacity *= 2;
+        }
+        uint8_t* newData = (uint8_t*)logMalloc(newCapacity);
+        memcpy(newData, data(), used);
+        logFree(heapData, capacity);
+        heapData = newData;
+        capacity = newCapacity;
+    }
+    uint8_t* at = (heapData ? heapData : inlineData) + used;
+    used += extra;
+    return at;
+}
+
+void LogArgs::put(Type type, const void* payload, size_t size)
+{
+    if (!fits(1 + size)) {
+        logAllocTruncated();
+        return;
+    }
+    uint8_t* at = reserve(1 + size);
+    at[0] = (uint8_t)type;
+    memcpy(at + 1, payload, size);
+    argCount++;
+}
+
+void LogArgs::addString(std::string_view value) { putString(Type::STRING, value); }
+
+void LogArgs::addKey(std::string_view key) { putString(Type::KEY, key); }
+
+void LogArgs::putString(Type type, std::string_view value)
+{
+    uint32_t length = (uint32_t)value.size();
+    if (!fits(1 + sizeof(length) + length)) {
+        logAllocTruncated();
+        if (!fits(1 + sizeof(length))) {
+            return;
+        }
+        length = (uint32_t)(this->capacity - this->used - 1 - sizeof(length));
+    }
+    uint8_t* at = reserve(1 + sizeof(length) + length);
+    at[0] = (uint8_t)type;
+    memcpy(at + 1, &length, sizeof(length));
+    memcpy(at + 1 + sizeof(length), value.data(), length);
+    argCount++;
+}
+
+void LogArgs::assign(const uint8_t* packed, size_t size, uint8_t count)
+{
+    clear();
+    memcpy(reserve(size), packed, size);
+    argCount = count;
+}
+
+bool LogArgsReader::next(LogArgValue& value)
+{
+    if (pos >= end) {
+        return false;
+    }
+    value.type = (LogArgs::Type)*pos++;
+    size_t payload = 0;
+    switch (value.type) {
+    case LogArgs::Type::INT:
+    case LogArgs::Type::UINT:
+    case LogArgs::Type::DOUBLE:
+    case LogArgs::Type::POINTER:
+        payload = 8;
+        break;
+    case LogArgs::Type::BOOL:
+    case LogArgs::Type::CHAR:
+        payload = 1;
+        break;
+    case LogArgs::Type::STRING:
+    case LogArgs::Type::KEY:
+        if (end - pos < (ptrdiff_t)sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&value.length, pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        payload = value.length;
+        break;
+    default:
+        return false;
+    }
+    if ((size_t)(end - pos) < payload) {
+        return false;
+    }
+    switch (value.type) {
+    case LogArgs::Type::INT:
+        memcpy(&value.i, pos, 8);
+        break;
+    case LogArgs::Type::UINT:
+    case LogArgs::Type::POINTER:
+        memcpy(&value.u, pos, 8);
+        break;
+    case LogArgs::Type::DOUBLE:
+        memcpy(&value.d, pos, 8);
+        break;
+    case LogArgs::Type::BOOL:
+        value.b = *pos != 0;
+        break;
+    case LogArgs::Type::CHAR:
+        value.c = (char)*pos;
+        break;
+    case LogArgs::Type::STRING:
+    case LogArgs::Type::KEY:
+        value.str = (const char*)pos;
+        break;
+    }
+    pos += payload;
+    return true;
+}
+
+bool LogArgsReader::nextPositional(LogArgValue& value)
+{
+    while (next(value)) {
+        if (value.type != LogArgs::Type::KEY) {
+            return true;
+        }
+        if (!next(value)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool LogArgsReader::nextField(LogArgValue& key, LogArgValue& value)
+{
+    while (next(key)) {
+        if (key.type == LogArgs::Type::KEY) {
+            return next(value);
+        }
+    }
+    return false;
+}
+
+void appendLogArg(LineBuffer& out, const LogArgValue& value)
+{
+    char number[numberFormatMaxChars + 2];
+    size_t size = 0;
+    switch (value.type) {
+    case LogArgs::Type::INT:
+        size = formatSigned(number, value.i);
+        break;
+    case LogArgs::Type::UINT:
+        size = formatUnsigned(number, value.u);
+        break;
+    case LogArgs::Type::DOUBLE:
+        size = formatDouble(number, value.d);
+        break;
+    case LogArgs::Type::POINTER:
+        number[0] = '0';
+        number[1] = 'x';
+        size = 2 + formatHex(number + 2, value.u);
+        break;
+    case LogArgs::Type::BOOL:
+        out.append(value.b ? "true" : "false");
+        return;
+    case LogArgs::Type::CHAR:
+        out.append(value.c);
+        return;
+    case LogArgs::Type::STRING:
+    case LogArgs::Type::KEY:
+        out.append(value.str, value.length);
+        return;
+    }
+    out.append(number, size);
+}
+
+void formatLogMessage(LineBuffer& out, const char* format, const uint8_t* args, size_t argsSize, bool appendFields)
+{
+    LogArgsReader reader(args, argsSize);
+    LogArgValue value;
+    const char* literal = format;
+    const char* c = format;
+    while (*c != '\0') {
+        if ((c[0] == '{' && c[1] == '{') || (c[0] == '}' && c[1] == '}')) {
+            out.append(literal, (size_t)(c - literal) + 1);
+            c += 2;
+            literal = c;
+        } else if (c[0] == '{' && c[1] == '}') {
+            out.append(literal, (size_t)(c - literal));
+            if (reader.nextPositional(value)) {
+                appendLogArg(out, value);
+            } else {
+                out.append("{}", 2);
+            }
+            c += 2;
+            literal = c;
+        } else {
+            c++;
+        }
+    }
+    out.append(literal, (size_t)(c - literal));
+
+    if (appendFields) {
+        LogArgsReader fields(args, argsSize);
+        LogArgValue key;
+        while (fields.nextField(key, value)) {
+            out.append(' ');
+            out.append(key.str, key.length);
+            out.append('=');
+            appendLogArg(out, value);
+        }
+    }
+}
@@ -0,0 +1,227 @@
+#ifndef LOG_FORMAT_HPP
+#define LOG_FORMAT_HPP
+
+#include "LineBuffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// A named value for structured logging, see kv(). Only refers to the value, it is copied when the record is captured.
+template <typename T>
+struct LogField {
+    const char* key;
+    const T& value;
+};
+
+template <typename T>
+struct isLogField : std::false_type {
+};
+template <typename T>
+struct isLogField<LogField<T>> : std::true_type {
+};
+
+/* Attach a named field to a log call: logger.info("order", kv("id", id), kv("ms", ms)).
+ * Fields don't fill "{}" placeholders, they are rendered after the message (or as JSON/logfmt keys).
+ *
+ * \param	char*	Field name, a string literal
+ * \param	T	The value, same types as positional arguments
+ */
+template <typename T>
+LogField<T> kv(const char* key, const T& value)
+{
+    return LogField<T> { key, value };
+}
+
+// Arguments of a deferred "req {} took {} us" style log call.
+// Values are captured by copy into one packed byte buffer (type tag + payload per argument) that lives
+// inline for typical calls, so a record can be queued and formatted later on another thread.
+// In the fixed capacity mode (Logger::setFixedCapacity()) the buffer never moves to the heap: a string is cut
+// to what is left of it, other values that don't fit are dropped and their "{}" stays.
+class LogArgs {
+public:
+    enum class Type : uint8_t { INT = 1,
+        UINT = 2,
+        DOUBLE = 3,
+        BOOL = 4,
+        CHAR = 5,
+        STRING = 6,
+        POINTER = 7,
+        KEY = 8 }; // name of a field, the value follows as the next argument
+
+#define logArgsInlineSize 96
+    LogArgs() = default;
+    LogArgs(const LogArgs&) = delete;
+    LogArgs& operator=(const LogArgs&) = delete;
+    LogArgs(LogArgs&& other) noexcept;
+    LogArgs& operator=(LogArgs&& other) noexcept;
+    ~LogArgs() { logFree(heapData, capacity); }
+
+    void clear()
+    {
+        used = 0;
+        argCount = 0;
+    }
+
+    /* Capture one argument. Supported: integers, floating point, bool, char, enums,
+     * strings (const char*, std::string, std::string_view) and other pointers (printed as hex).
+     *
+     * \param	T	The value to copy into the record
+     */
+    template <typename T>
+    void add(const T& value)
+    {
+        using D = std::decay_t<T>;
+        if constexpr (isLogField<D>::value) {
+            addKey(value.key);
+            add(value.value);
+        } else if constexpr (std::is_same_v<D, bool>) {
+            uint8_t b = value ? 1 : 0;
+            put(Type::BOOL, &b, 1);
+        } else if constexpr (std::is_same_v<D, char>) {
+            put(Type::CHAR, &value, 1);
+        } else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>) {
+            int64_t v = value;
+            put(Type::INT, &v, sizeof(v));
+        } else if constexpr (std::is_integral_v<D>) {
+            uint64_t v = value;
+            put(Type::UINT, &v, sizeof(v));
+        } else if constexpr (std::is_enum_v<D>) {
+            int64_t v = static_cast<int64_t>(value);
+            put(Type::INT, &v, sizeof(v));
+        } else if constexpr (std::is_floating_point_v<D>) {
+            double v = value;
+            put(Type::DOUBLE, &v, sizeof(v));
+        } else if constexpr (std::is_array_v<T> && std::is_same_v<std::remove_cv_t<std::remove_extent_t<T>>, char>) {
+            addString(std::string_view(value));
+        } else if constexpr (std::is_same_v<D, const char*> || std::is_same_v<D, char*>) {
+            addString(value ? std::string_view(value) : std::string_view("(null)"));
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            addString(std::string_view(value));
+        } else if constexpr (std::is_pointer_v<D>) {
+            uint64_t v = reinterpret_cast<uintptr_t>(value);
+            put(Type::POINTER, &v, sizeof(v));
+        } else {
+            static_assert(std::is_pointer_v<D>, "unsupported log argument type");
+        }
+    }
+
+    void addString(std::string_view value);
+    void addKey(std::string_view key);
+
+    // Replace the content with an already packed buffer (used by decoders).
+    void assign(const uint8_t* packed, size_t size, uint8_t count);
+
+    const uint8_t* data() const { return heapData ? heapData : inlineData; }
+    size_t size() const { return used; }
+    // total number of entries, a field counts twice (key and value)
+    uint8_t count() const { return argCount; }
+
+private:
+    uint8_t inlineData[logArgsInlineSize];
+    uint8_t* heapData = nullptr;
+    size_t used = 0;
+    size_t capacity = logArgsInlineSize;
+    uint8_t argCount = 0;
+
+    uint8_t* reserve(size_t extra);
+    // false if extra more bytes would need the heap in the fixed capacity mode
+    bool fits(size_t extra) const
+    {
+        return this->used + extra <= this->capacity || !logFixedCapacity.load(std::memory_order_relaxed);
+    }
+    void put(Type type, const void* payload, size_t size);
+    void putString(Type type, std::string_view value);
+};
+
+// One decoded argument, strings point into the packed buffer.
+struct LogArgValue {
+    LogArgs::Type type;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        bool b;
+        char c;
+    };
+    const char* str = nullptr;
+    uint32_t length = 0;
+};
+
+// Walks a packed LogArgs buffer.
+class LogArgsReader {
+public:
+    LogArgsReader(const uint8_t* data, size_t size)
+        : pos(data)
+        , end(data + size)
+    {
+    }
+
+    /* Decode the next argument.
+     *
+     * \param	LogArgValue	Receives the argument
+     * \return	bool	false at the end of the buffer (or if it is malformed)
+     */
+    bool next(LogArgValue& value);
+
+    /* Decode the next argument that isn't part of a field.
+     */
+    bool nextPositional(LogArgValue& value);
+
+    /* Decode the next field, positional arguments are skipped.
+     *
+     * \param	LogArgValue	Receives the key (as a string)
+     * \param	LogArgValue	Receives the value
+     */
+    bool nextField(LogArgValue& key, LogArgValue& value);
+
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+};
+
+/* Append the text form of one argument.
+ */
+void appendLogArg(LineBuffer& out, const LogArgValue& value);
+
+/* Render a "{}" format string with packed arguments.
+ * "{{" and "}}" are literal braces, placeholders without a matching argument are kept as "{}".
+ * Fields are appended as " key=value" unless appendFields is false.
+ *
+ * \param	LineBuffer	Output, appended to
+ * \param	char*	The format string
+ * \param	uint8_t*	Packed arguments (LogArgs::data())
+ * \param	size_t	Size of the packed arguments
+ * \param	bool	Append the fields after the message
+ */
+void formatLogMessage(
+    LineBuffer& out, const char* format, const uint8_t* args, size_t argsSize, bool appendFields = true);
+
+#pragma region compile time checks
+// Number of "{}" placeholders, usable in static_assert on string literals.
+constexpr size_t logFormatPlaceholders(const char* format)
+{
+    size_t count = 0;
+    for (size_t i = 0; format[i] != '\0'; i++) {
+        if (format[i] == '{') {
+            if (format[i + 1] == '{') {
+                i++;
+            } else if (format[i + 1] == '}') {
+                count++;
+                i++;
+            }
+        } else if (format[i] == '}' && format[i + 1] == '}') {
+            i++;
+        }
+    }
+    return count;
+}
+
+// Only used in decltype to count macro arguments without evaluating them, fields don't take a placeholder.
+template <typename... Args>
+std::integral_constant<size_t, (0 + ... + (isLogField<Args>::value ? 0 : 1))> logFormatArgCount(const Args&...);
+#pragma endregion compile time checks
+
+#endif // LOG_FORMAT_HPP
@@ -0,0 +1,93 @@
+#ifndef LOG_LEVEL_HPP
+#define LOG_LEVEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+enum class Target : short { DISABLED = 0,
+    STDOUT = 1,
+    STDERR = 2,
+    LOG_FILE = 4,
+    LOG_BINARY = 8, // call site dictionary + packed arguments, see BinaryLog.hpp
+    LOG_MMAP = 16 }; // text lines copied into a memory mapped file, see MmapLogFile.hpp
+
+enum class Level : short { DEB = 1,
+    INFO = 2,
+    NOTICE = 3,
+    WARNING = 4,
+    ERR = 5,
+    CRIT = 6,
+    ALERT = 7,
+    EMERG = 8 };
+
+// Digits printed after the seconds of the timestamp.
+enum class TimestampPrecision : short { SECONDS = 0,
+    MILLISECONDS = 1,
+    MICROSECONDS = 2 };
+
+// How the timestamp is printed.
+enum class TimestampMode : short { LOCAL = 0, // [17/Oct/2026 11:46:00]
+    UTC_ISO8601 = 1, // [2026-10-17T09:46:00Z]
+    ELAPSED = 2 }; // [+12] seconds since the Logger was created, from the monotonic clock
+
+// Level, targets and line style of a Logger. The Logger keeps them packed in one atomic word and every log call
+// loads it once, so a line is never written with half of the settings of a reload.
+struct LoggerState {
+    Level level = Level::INFO;
+    short targets = 0; // Target bits
+    bool timestamp = true;
+    bool showLevel = true;
+    bool fileInfo = false;
+    // a time is taken and printed in the same mode, so both come with the rest of the settings
+    TimestampPrecision timestampPrecision = TimestampPrecision::SECONDS;
+    TimestampMode timestampMode = TimestampMode::LOCAL;
+    // bumped by every change, LogCategory levels set by the same change apply from this generation on
+    uint16_t generation = 0;
+
+    uint64_t pack() const
+    {
+        return (uint64_t)(uint8_t)this->level | (uint64_t)(uint16_t)this->targets << 8 | (uint64_t)this->timestamp << 24
+            | (uint64_t)this->showLevel << 25 | (uint64_t)this->fileInfo << 26
+            | (uint64_t)((uint8_t)this->timestampPrecision & 3) << 27 | (uint64_t)((uint8_t)this->timestampMode & 3) << 29
+            | (uint64_t)this->generation << 32;
+    }
+
+    static LoggerState unpack(uint64_t word)
+    {
+        LoggerState state;
+        state.level = (Level)(word & 0xff);
+        state.targets = (short)((word >> 8) & 0xffff);
+        state.timestamp = (word >> 24) & 1;
+        state.showLevel = (word >> 25) & 1;
+        state.fileInfo = (word >> 26) & 1;
+        state.timestampPrecision = (TimestampPrecision)((word >> 27) & 3);
+        state.timestampMode = (TimestampMode)((word >> 29) & 3);
+        state.generation = (uint16_t)(word >> 32);
+        return state;
+    }
+};
+
+// String representations of Logger levels
+static const std::map<Level, const char*> levelMap = {
+    { Level::DEB, "DEBUG" },
+    { Level::INFO, "INFO" },
+    { Level::NOTICE, "NOTICE" },
+    { Level::WARNING, "WARNING" },
+    { Level::ERR, "ERROR" },
+    { Level::CRIT, "CRITICAL" },
+    { Level::ALERT, "ALERT" },
+    { Level::EMERG, "EMERGENCY" } //
+};
+
+// Same names indexed by the level value. No lookup that allocates or throws, so the crash handler can use it.
+static const char* const levelNames[] = { "UNKNOWN", "DEBUG", "INFO", "NOTICE", "WARNING", "ERROR", "CRITICAL", "ALERT",
+    "EMERGENCY" };
+
+inline const char* levelName(Level level)
+{
+    size_t index = (size_t)level;
+    return index < sizeof(levelNames) / sizeof(levelNames[0]) ? levelNames[index] : levelNames[0];
+}
+
+#endif // LOG_LEVEL_HPP
@@ -0,0 +1,154 @@
+#ifndef LOG_QUEUE_HPP
+#define LOG_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free ring used by the async Logger.
+// It is a Vyukov style queue: every cell carries a sequence number so producers and consumers only
+// ever contend on a single fetch/CAS of their own cursor. Many producers are supported and popping is
+// safe from more than one thread too, which the DROP_OLDEST overflow policy relies on.
+template <typename T>
+class LogQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static constexpr size_t cacheLineSize = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(cacheLineSize) std::atomic<size_t> enqueuePos { 0 };
+    alignas(cacheLineSize) std::atomic<size_t> dequeuePos { 0 };
+
+public:
+    /* Create a queue, capacity is rounded up to a power of two (minimum 2).
+     *
+     * \param	size_t	Requested number of slots
+     */
+    explicit LogQueue(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        this->cells = std::make_unique<Cell[]>(size);
+        this->mask = size - 1;
+        for (size_t i = 0; i < size; i++) {
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LogQueue(const LogQueue&) = delete;
+    LogQueue& operator=(const LogQueue&) = delete;
+
+    /* Try to append a value, the value is only moved from on success.
+     *
+     * \param	T	Value to enqueue
+     * \return	bool	false if the queue is full
+     */
+    bool tryPush(T& value)
+    {
+        Cell* cell;
+        size_t pos = this->enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &this->cells[pos & this->mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (this->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = this->enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Try to take the oldest value.
+     *
+     * \param	T	Receives the value
+     * \param	size_t	Receives the position of the value in the queue, see pushed()
+     * \return	bool	false if the queue is empty
+     */
+    bool tryPop(T& value, size_t* position = nullptr)
+    {
+        Cell* cell;
+        size_t pos = this->dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &this->cells[pos & this->mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (this->dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = this->dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + this->mask + 1, std::memory_order_release);
+        if (position) {
+            *position = pos;
+        }
+        return true;
+    }
+
+    /* Visit the values still queued, oldest first, without removing them.
+     * Takes no locks and doesn't allocate, for the crash handler. Cells that are being written are skipped,
+     * and so is the oldest one, which the consumer may be moving out. A cell the consumer reaches while it is
+     * visited ends the walk, every cell after it is at risk as well.
+     *
+     * \param	Visitor	Called with each const T&
+     */
+    template <typename Visitor>
+    void peek(Visitor&& visit) const
+    {
+        size_t end = this->enqueuePos.load(std::memory_order_acquire);
+        size_t pos = this->dequeuePos.load(std::memory_order_acquire);
+        if (pos == end) {
+            return;
+        }
+        for (pos++; pos != end; pos++) {
+            const Cell& cell = this->cells[pos & this->mask];
+            if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+                continue;
+            }
+            // the consumer claims a cell by moving dequeuePos past it before it moves the value out
+            if ((intptr_t)(this->dequeuePos.load(std::memory_order_acquire) - pos) >= 0) {
+                continue;
+            }
+            visit(cell.data);
+            if (cell.sequence.load(std::memory_order_acquire) != pos + 1
+                || (intptr_t)(this->dequeuePos.load(std::memory_order_acquire) - pos) > 0) {
+                return;
+            }
+        }
+    }
+
+    size_t capacity() const { return this->mask + 1; }
+
+    // Positions handed out to producers so far, every value whose tryPush() returned is below it.
+    size_t pushed() const { return this->enqueuePos.load(std::memory_order_acquire); }
+
+    // Only a hint while producers/consumers are running.
+    bool empty() const
+    {
+        return this->enqueuePos.load(std::memory_order_acquire) == this->dequeuePos.load(std::memory_order_acquire);
+    }
+};
+
+#endif // LOG_QUEUE_HPP
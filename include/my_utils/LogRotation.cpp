@@ -0,0 +1,190 @@
+#include "LogRotation.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// only stbi_zlib_compress is used, keep the whole implementation private to this file
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#define STB_IMAGE_WRITE_STATIC
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "../external_utils/stb_image_write.h"
+#pragma GCC diagnostic pop
+
+// Input compressed per gzip member, bounds the memory used for any segment size.
+#define gzipMemberBytes (1 << 20)
+
+namespace {
+uint32_t crc32(const unsigned char* data, size_t size)
+{
+    static uint32_t table[256];
+    static bool tableReady = [] {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)tableReady;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void putLE32(unsigned char* out, uint32_t value)
+{
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+    out[2] = (unsigned char)(value >> 16);
+    out[3] = (unsigned char)(value >> 24);
+}
+
+// One complete gzip member (header, deflate stream, crc32 and size) for a block of data.
+bool writeGzipMember(FILE* out, const unsigned char* data, size_t size)
+{
+    const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+    unsigned char trailer[8];
+    putLE32(trailer, crc32(data, size));
+    putLE32(trailer + 4, (uint32_t)size);
+    if (size == 0) {
+        // stb doesn't finish the stream for empty input, a single empty fixed Huffman block
+        const unsigned char empty[2] = { 0x03, 0x00 };
+        return fwrite(header, 1, sizeof(header), out) == sizeof(header)
+            && fwrite(empty, 1, sizeof(empty), out) == sizeof(empty)
+            && fwrite(trailer, 1, sizeof(trailer), out) == sizeof(trailer);
+    }
+
+    // stb produces a zlib stream: 2 byte header, raw deflate, 4 byte adler32
+    int zlibSize = 0;
+    unsigned char* zlib = stbi_zlib_compress(const_cast<unsigned char*>(data), (int)size, &zlibSize, 8);
+    if (!zlib || zlibSize < 6) {
+        free(zlib);
+        return false;
+    }
+    bool ok = fwrite(header, 1, sizeof(header), out) == sizeof(header)
+        && fwrite(zlib + 2, 1, (size_t)zlibSize - 6, out) == (size_t)zlibSize - 6
+        && fwrite(trailer, 1, sizeof(trailer), out) == sizeof(trailer);
+    free(zlib);
+    return ok;
+}
+} // namespace
+
+bool gzipFile(const std::string& source, const std::string& destination)
+{
+    FILE* in = fopen(source.c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    FILE* out = fopen(destination.c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    // gunzip concatenates the members, so the file is compressed a block at a time
+    std::vector<unsigned char> block(gzipMemberBytes);
+    bool ok = true;
+    bool more = true;
+    bool first = true;
+    while (ok && more) {
+        size_t size = 0;
+        size_t read;
+        while (size < block.size() && (read = fread(block.data() + size, 1, block.size() - size, in)) > 0) {
+            size += read;
+        }
+        more = size == block.size();
+        // an empty file still gets one (empty) member
+        if (size > 0 || first) {
+            ok = writeGzipMember(out, block.data(), size);
+        }
+        first = false;
+    }
+    ok = !ferror(in) && ok;
+    fclose(in);
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        remove(destination.c_str());
+    }
+    return ok;
+}
+
+LogRotator::~LogRotator()
+{
+    {
+        std::scoped_lock<std::mutex> lock(mxJobs);
+        stopping = true;
+    }
+    cvJobs.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void LogRotator::submit(const std::string& segment, const std::string& baseName, const LogRotation& rotation)
+{
+    {
+        std::scoped_lock<std::mutex> lock(mxJobs);
+        jobs.push_back({ segment, baseName, rotation });
+        if (!worker.joinable()) {
+            worker = std::thread(&LogRotator::run, this);
+        }
+    }
+    cvJobs.notify_one();
+}
+
+void LogRotator::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(mxJobs);
+    cvIdle.wait(lock, [this] { return jobs.empty() && !busy; });
+}
+
+void LogRotator::run()
+{
+    std::unique_lock<std::mutex> lock(mxJobs);
+    for (;;) {
+        cvJobs.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) {
+            return;
+        }
+        Job job = std::move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+        process(job);
+        lock.lock();
+        busy = false;
+        if (jobs.empty()) {
+            cvIdle.notify_all();
+        }
+    }
+}
+
+void LogRotator::process(const Job& job)
+{
+    // jobs run one at a time in rotation order, so shifting the numbered files can't race
+    const std::string extension = job.rotation.compress ? ".gz" : "";
+    unsigned int keep = job.rotation.keepFiles;
+    if (keep == 0) {
+        remove(job.segment.c_str());
+        return;
+    }
+    remove((job.baseName + "." + std::to_string(keep) + extension).c_str());
+    for (unsigned int i = keep - 1; i > 0; i--) {
+        rename((job.baseName + "." + std::to_string(i) + extension).c_str(),
+            (job.baseName + "." + std::to_string(i + 1) + extension).c_str());
+    }
+    std::string newest = job.baseName + ".1";
+    if (job.rotation.compress && gzipFile(job.segment, newest + extension)) {
+        remove(job.segment.c_str());
+    } else {
+        // keep the data even if compression failed
+        rename(job.segment.c_str(), newest.c_str());
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef LOG_ROTATION_HPP
+#define LOG_ROTATION_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// When the LOG_FILE target starts a new file. A zero limit is not checked.
+struct LogRotation {
+    size_t maxBytes = 0;
+    std::chrono::seconds maxAge { 0 };
+    // rotated files kept as <file>.1 (newest) ... <file>.N
+    unsigned int keepFiles = 5;
+    // gzip rotated files to <file>.N.gz
+    bool compress = true;
+
+    bool enabled() const { return maxBytes > 0 || maxAge.count() > 0; }
+};
+
+/* gzip a file with the deflate stream from stb_image_write. The file is read and compressed in 1 MB blocks,
+ * each written as its own gzip member, so memory use doesn't depend on the file size.
+ *
+ * \param	string	File to compress
+ * \param	string	.gz file to create
+ * \return	bool	false if reading, compressing or writing failed
+ */
+bool gzipFile(const std::string& source, const std::string& destination);
+
+// Background worker that renumbers and compresses rotated log files, so logging threads
+// only pay for a rename() and reopening the file.
+class LogRotator {
+public:
+    LogRotator() = default;
+    LogRotator(const LogRotator&) = delete;
+    LogRotator& operator=(const LogRotator&) = delete;
+    // finishes every queued job
+    ~LogRotator();
+
+    /* Queue a rotated segment.
+     *
+     * \param	string	Temporary name the segment was renamed to
+     * \param	string	Name of the log file, rotated files are named after it
+     * \param	LogRotation	Settings at the time of the rotation
+     */
+    void submit(const std::string& segment, const std::string& baseName, const LogRotation& rotation);
+
+    /* Block until every queued segment has been renamed/compressed.
+     */
+    void waitIdle();
+
+private:
+    struct Job {
+        std::string segment;
+        std::string baseName;
+        LogRotation rotation;
+    };
+
+    std::thread worker;
+    std::mutex mxJobs;
+    std::condition_variable cvJobs;
+    std::condition_variable cvIdle;
+    std::deque<Job> jobs;
+    bool busy = false;
+    bool stopping = false;
+
+    void run();
+    static void process(const Job& job);
+};
+
+#endif // LOG_ROTATION_HPP
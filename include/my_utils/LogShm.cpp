@@ -0,0 +1,214 @@
+#include "LogShm.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+size_t alignRecord(size_t size)
+{
+    return (size + logShmRecordAlign - 1) & ~(size_t)(logShmRecordAlign - 1);
+}
+
+const LogShmRecordHeader* recordAt(const char* ring, size_t mask, uint64_t position)
+{
+    return (const LogShmRecordHeader*)(ring + (position & mask));
+}
+} // namespace
+
+#pragma region LogShmWriter
+bool LogShmWriter::open(const std::string& name, size_t capacity)
+{
+    close();
+    size_t size = 4096;
+    while (size < capacity) {
+        size *= 2;
+    }
+    int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (descriptor < 0) {
+        return false;
+    }
+    size_t total = logShmHeaderSize + size;
+    struct stat objectStat;
+    bool reuse = fstat(descriptor, &objectStat) == 0 && (size_t)objectStat.st_size == total;
+    if (!reuse && ftruncate(descriptor, (off_t)total) != 0) {
+        ::close(descriptor);
+        return false;
+    }
+    void* mapping = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    this->header = (LogShmHeader*)mapping;
+    this->ring = (char*)mapping + logShmHeaderSize;
+    this->mask = size - 1;
+    this->mappedSize = total;
+
+    if (!reuse || this->header->magic != logShmMagic || this->header->version != logShmVersion
+        || this->header->capacity != size) {
+        // readers check the magic before anything else
+        this->header->magic = 0;
+        this->header->version = logShmVersion;
+        this->header->capacity = size;
+        this->header->dataOffset = logShmHeaderSize;
+        this->header->writePos.store(0, std::memory_order_relaxed);
+        memset(this->ring, 0, size);
+        std::atomic_thread_fence(std::memory_order_release);
+        this->header->magic = logShmMagic;
+    }
+    return true;
+}
+
+void LogShmWriter::close()
+{
+    if (this->header) {
+        munmap(this->header, this->mappedSize);
+        this->header = nullptr;
+        this->ring = nullptr;
+    }
+}
+
+void LogShmWriter::write(const char* data, size_t size, uint8_t level)
+{
+    if (!this->header) {
+        return;
+    }
+    size = std::min(size, this->capacity() / 4);
+    size_t recordSize = alignRecord(sizeof(LogShmRecordHeader) + size);
+
+    // reserve the record, plus padding up to the end of the ring if it would not fit before it
+    uint64_t position = this->header->writePos.load(std::memory_order_relaxed);
+    uint64_t padding;
+    do {
+        size_t offset = position & this->mask;
+        padding = offset + recordSize > this->capacity() ? this->capacity() - offset : 0;
+    } while (!this->header->writePos.compare_exchange_weak(
+        position, position + padding + recordSize, std::memory_order_relaxed));
+    // seqlock writer: the reservation is visible before any byte of the old data changes
+    std::atomic_thread_fence(std::memory_order_release);
+
+    if (padding) {
+        LogShmRecordHeader* pad = (LogShmRecordHeader*)(this->ring + (position & this->mask));
+        pad->sequence.store(0, std::memory_order_relaxed);
+        pad->length = (uint32_t)(padding - sizeof(LogShmRecordHeader));
+        pad->level = 0;
+        pad->flags = LOG_SHM_PADDING;
+        pad->reserved = 0;
+        pad->sequence.store(position ^ logShmSequenceKey, std::memory_order_release);
+        position += padding;
+    }
+
+    LogShmRecordHeader* record = (LogShmRecordHeader*)(this->ring + (position & this->mask));
+    record->sequence.store(0, std::memory_order_relaxed);
+    record->length = (uint32_t)size;
+    record->level = level;
+    record->flags = 0;
+    record->reserved = 0;
+    memcpy((char*)record + sizeof(LogShmRecordHeader), data, size);
+    record->sequence.store(position ^ logShmSequenceKey, std::memory_order_release);
+}
+#pragma endregion LogShmWriter
+
+#pragma region LogShmReader
+bool LogShmReader::open(const std::string& name, bool fromOldest)
+{
+    close();
+    int descriptor = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (descriptor < 0) {
+        return false;
+    }
+    struct stat objectStat;
+    if (fstat(descriptor, &objectStat) != 0 || (size_t)objectStat.st_size <= logShmHeaderSize) {
+        ::close(descriptor);
+        return false;
+    }
+    size_t total = (size_t)objectStat.st_size;
+    void* mapping = mmap(nullptr, total, PROT_READ, MAP_SHARED, descriptor, 0);
+    ::close(descriptor);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const LogShmHeader* shared = (const LogShmHeader*)mapping;
+    bool valid = shared->magic == logShmMagic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || shared->version != logShmVersion || shared->capacity + logShmHeaderSize != total) {
+        munmap(mapping, total);
+        return false;
+    }
+    this->header = shared;
+    this->ring = (const char*)mapping + shared->dataOffset;
+    this->mask = shared->capacity - 1;
+    this->mappedSize = total;
+
+    // record boundaries are only known from position 0 on, so the oldest data is only reachable before a wrap
+    uint64_t end = shared->writePos.load(std::memory_order_acquire);
+    this->readPos = fromOldest && end <= shared->capacity ? 0 : end;
+    return true;
+}
+
+void LogShmReader::close()
+{
+    if (this->header) {
+        munmap((void*)this->header, this->mappedSize);
+        this->header = nullptr;
+        this->ring = nullptr;
+    }
+}
+
+void LogShmReader::skipTo(uint64_t position)
+{
+    this->overruns++;
+    this->lostBytes += position - this->readPos;
+    this->readPos = position;
+}
+
+bool LogShmReader::next(LogShmRecord& out)
+{
+    if (!this->header) {
+        return false;
+    }
+    for (;;) {
+        uint64_t end = this->header->writePos.load(std::memory_order_acquire);
+        if (end == this->readPos) {
+            return false;
+        }
+        if (end - this->readPos > this->mask + 1) {
+            skipTo(end);
+            return false;
+        }
+        const LogShmRecordHeader* record = recordAt(this->ring, this->mask, this->readPos);
+        if (record->sequence.load(std::memory_order_acquire) != (this->readPos ^ logShmSequenceKey)) {
+            // reserved but not committed yet
+            return false;
+        }
+        LogShmRecord found;
+        found.position = this->readPos;
+        found.length = record->length;
+        found.level = record->level;
+        found.data = (const char*)(record + 1);
+        uint8_t flags = record->flags;
+        // the header fields may have been overwritten by a lapping writer while they were read
+        if (!isValid(found) || found.length > this->mask + 1) {
+            skipTo(this->header->writePos.load(std::memory_order_acquire));
+            return false;
+        }
+        this->readPos += alignRecord(sizeof(LogShmRecordHeader) + found.length);
+        if (flags & LOG_SHM_PADDING) {
+            continue;
+        }
+        out = found;
+        return true;
+    }
+}
+
+bool LogShmReader::isValid(const LogShmRecord& record) const
+{
+    // seqlock reader: everything read before must not be reordered after the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t end = this->header->writePos.load(std::memory_order_relaxed);
+    return end - record.position <= this->mask + 1;
+}
+#pragma endregion LogShmReader
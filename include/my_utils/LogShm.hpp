@@ -0,0 +1,150 @@
+#ifndef LOG_SHM_HPP
+#define LOG_SHM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// POSIX shared memory ring used by ShmSink to hand log data to another process (a log shipper) without a file.
+//
+// Layout of the shm_open() object (native byte order, same architecture on both sides):
+//   0     header, logShmHeaderSize bytes
+//           u32 magic "ULSR", u32 version, u64 capacity (power of two), u64 dataOffset,
+//           u64 writePos at offset 64 (own cache line)
+//   4096  data, capacity bytes used as a ring
+// Positions are byte counts since the ring was created and only grow, the ring offset is position & (capacity - 1).
+// writePos is the end of the last reserved record, not necessarily a committed one.
+//
+// Record, 16 byte aligned, never wraps around the end of the data area:
+//   u64 sequence (position of the record ^ logShmSequenceKey, stored last with release ordering)
+//   u32 length of the payload, u8 level, u8 flags (LOG_SHM_PADDING: skip, fills the end of the ring), u16 0
+//   payload: one or more complete rendered lines
+//
+// Writers reserve space with a CAS on writePos and never wait for readers. A reader that falls more than capacity
+// bytes behind has been overrun: the data it was about to read is gone, it counts the loss and skips to writePos.
+#define logShmMagic 0x52534c55u // "ULSR"
+#define logShmVersion 1u
+#define logShmHeaderSize 4096
+#define logShmRecordAlign 16
+#define logShmSequenceKey 0x9e3779b97f4a7c15ull
+#define logShmDefaultCapacity (4 * 1024 * 1024)
+
+enum LogShmFlags : uint8_t { LOG_SHM_PADDING = 1 };
+
+struct LogShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t dataOffset;
+    uint8_t reserved[40];
+    std::atomic<uint64_t> writePos;
+};
+static_assert(offsetof(LogShmHeader, writePos) == 64, "LogShmHeader layout changed");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs address free atomics");
+
+struct LogShmRecordHeader {
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    uint8_t level;
+    uint8_t flags;
+    uint16_t reserved;
+};
+static_assert(sizeof(LogShmRecordHeader) == logShmRecordAlign, "LogShmRecordHeader layout changed");
+
+// Publishing side, used by ShmSink. Safe to call from many threads at once.
+class LogShmWriter {
+public:
+    LogShmWriter() = default;
+    LogShmWriter(const LogShmWriter&) = delete;
+    LogShmWriter& operator=(const LogShmWriter&) = delete;
+    ~LogShmWriter() { close(); }
+
+    /* Create or reuse a shared memory ring. An existing ring of the same capacity is continued, so readers
+     * that are attached keep their place; anything else is reinitialized.
+     *
+     * \param	string	shm_open() name, "/name"
+     * \param	size_t	Data capacity, rounded up to a power of two
+     * \return	bool	false if the object could not be created or mapped
+     */
+    bool open(const std::string& name, size_t capacity = logShmDefaultCapacity);
+
+    /* Unmap the ring. The shared memory object stays until shm_unlink(), readers may still be draining it.
+     */
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    /* Copy data into the ring as one record. Never blocks, data beyond a quarter of the capacity is cut off.
+     *
+     * \param	char*	Payload
+     * \param	size_t	Payload size
+     * \param	uint8_t	Level stored with the record
+     */
+    void write(const char* data, size_t size, uint8_t level);
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    LogShmHeader* header = nullptr;
+    char* ring = nullptr;
+    size_t mask = 0;
+    size_t mappedSize = 0;
+};
+
+// A record as seen by LogShmReader, pointing straight into the shared memory.
+struct LogShmRecord {
+    uint64_t position = 0;
+    const char* data = nullptr;
+    uint32_t length = 0;
+    uint8_t level = 0;
+};
+
+// Consuming side, zero copy: next() hands out pointers into the mapping. A writer may overwrite a record at any
+// time once the reader is a full ring behind, so check isValid() after using one.
+class LogShmReader {
+public:
+    LogShmReader() = default;
+    LogShmReader(const LogShmReader&) = delete;
+    LogShmReader& operator=(const LogShmReader&) = delete;
+    ~LogShmReader() { close(); }
+
+    /* Map an existing ring read only.
+     *
+     * \param	string	shm_open() name
+     * \param	bool	Start with the first record if the ring hasn't wrapped yet, instead of only new records
+     * \return	bool	false if it doesn't exist or isn't a ring of this version
+     */
+    bool open(const std::string& name, bool fromOldest = false);
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    /* Next committed record, padding is skipped.
+     *
+     * \param	LogShmRecord	Receives the record, valid until isValid() returns false
+     * \return	bool	false if there is nothing new (or the next record is still being written)
+     */
+    bool next(LogShmRecord& record);
+
+    /* Whether a record handed out by next() is still intact, i.e. no writer has reserved its bytes again.
+     * Call after reading the payload, a false result means what was read may be torn.
+     */
+    bool isValid(const LogShmRecord& record) const;
+
+    // Number of times the reader was overrun and skipped ahead, and the bytes it lost doing so.
+    uint64_t getOverrunCount() const { return overruns; }
+    uint64_t getLostBytes() const { return lostBytes; }
+    uint64_t position() const { return readPos; }
+
+private:
+    const LogShmHeader* header = nullptr;
+    const char* ring = nullptr;
+    size_t mask = 0;
+    size_t mappedSize = 0;
+    uint64_t readPos = 0;
+    uint64_t overruns = 0;
+    uint64_t lostBytes = 0;
+
+    void skipTo(uint64_t position);
+};
+
+#endif // LOG_SHM_HPP
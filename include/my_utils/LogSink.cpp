@@ -0,0 +1,156 @@
+#include "LogSink.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void PlainFormatter::format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const
+{
+    (void)logger;
+    out.append(entry.message);
+    out.append('\n');
+}
+
+#pragma region FileSink
+FileSink::FileSink(const std::string& fileName, bool deleteFile, bool flushEveryWrite)
+    : flushEveryWrite(flushEveryWrite)
+{
+    if (deleteFile) {
+        remove(fileName.c_str());
+    }
+    file.open(fileName);
+}
+
+void FileSink::write(const char* data, size_t size, Level maxLevel)
+{
+    (void)maxLevel;
+    std::scoped_lock<std::mutex> lock(mxFile);
+    file.write(data, size);
+    if (flushEveryWrite) {
+        file.flush();
+    }
+}
+
+void FileSink::flush()
+{
+    std::scoped_lock<std::mutex> lock(mxFile);
+    file.flush();
+}
+#pragma endregion FileSink
+
+#pragma region RingSink
+RingSink::RingSink(size_t capacity)
+    : ring(std::max<size_t>(capacity, 1))
+{
+}
+
+void RingSink::write(const char* data, size_t size, Level maxLevel)
+{
+    (void)maxLevel;
+    std::scoped_lock<std::mutex> lock(mxRing);
+    if (size >= ring.size()) {
+        // only the tail fits
+        memcpy(ring.data(), data + size - ring.size(), ring.size());
+        head = 0;
+        wrapped = true;
+        return;
+    }
+    size_t first = std::min(size, ring.size() - head);
+    memcpy(ring.data() + head, data, first);
+    memcpy(ring.data(), data + first, size - first);
+    if (head + size >= ring.size()) {
+        wrapped = true;
+    }
+    head = (head + size) % ring.size();
+}
+
+std::string RingSink::contents() const
+{
+    std::scoped_lock<std::mutex> lock(mxRing);
+    if (!wrapped) {
+        return std::string(ring.data(), head);
+    }
+    std::string result(ring.data() + head, ring.size() - head);
+    result.append(ring.data(), head);
+    return result;
+}
+#pragma endregion RingSink
+
+#pragma region UnixSocketSink
+namespace {
+sockaddr_un socketAddress(const std::string& path)
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+} // namespace
+
+UnixSocketSink::UnixSocketSink(const std::string& socketPath)
+    : socketPath(socketPath)
+{
+    descriptor = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (descriptor >= 0) {
+        reconnect();
+    }
+}
+
+bool UnixSocketSink::reconnect()
+{
+    // a datagram socket can be connected again, e.g. to a receiver that was restarted on a new socket file
+    sockaddr_un address = socketAddress(this->socketPath);
+    bool ok = connect(descriptor, (const sockaddr*)&address, sizeof(address)) == 0;
+    connected.store(ok, std::memory_order_release);
+    return ok;
+}
+
+UnixSocketSink::~UnixSocketSink()
+{
+    if (descriptor >= 0) {
+        ::close(descriptor);
+    }
+}
+
+void UnixSocketSink::write(const char* data, size_t size, Level maxLevel)
+{
+    (void)maxLevel;
+    if (descriptor < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!connected.load(std::memory_order_acquire)) {
+        // one thread tries per interval, the others drop without a syscall
+        auto since = std::chrono::steady_clock::now().time_since_epoch();
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+        int64_t at = retryAt.load(std::memory_order_relaxed);
+        if (now < at || !retryAt.compare_exchange_strong(at, now + unixSocketRetryInterval) || !reconnect()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (send(descriptor, data, size, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        // the receiver closed its socket, a full buffer (EAGAIN) only drops this datagram
+        if (errno == ECONNREFUSED || errno == ENOTCONN) {
+            connected.store(false, std::memory_order_release);
+        }
+    }
+}
+#pragma endregion UnixSocketSink
+
+#pragma region ShmSink
+ShmSink::ShmSink(const std::string& name, size_t capacity)
+{
+    ring.open(name, capacity);
+}
+
+void ShmSink::write(const char* data, size_t size, Level maxLevel)
+{
+    ring.write(data, size, (uint8_t)maxLevel);
+}
+#pragma endregion ShmSink
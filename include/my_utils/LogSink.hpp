@@ -0,0 +1,195 @@
+#ifndef LOG_SINK_HPP
+#define LOG_SINK_HPP
+
+#include "LineBuffer.hpp"
+#include "LogFile.hpp"
+#include "LogFormat.hpp"
+#include "LogLevel.hpp"
+#include "LogShm.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <experimental/source_location>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Logger;
+
+// What sinks and formatters see of a log call.
+struct LogEntry {
+    Level level = Level::INFO;
+    int64_t time = 0; // see Logger::timestampNow()
+    std::experimental::source_location location;
+    // message body, "{}" placeholders already filled in
+    const char* message = "";
+    // set for format calls, for sinks that want the raw arguments
+    const char* format = nullptr;
+    const LogArgs* args = nullptr;
+    // name of the LogCategory that logged it, nullptr for the Logger itself
+    const char* category = nullptr;
+    // the Logger's targets and style flags when it was logged
+    LoggerState state;
+};
+
+// Turns an entry into the bytes handed to a sink. The Logger renders every entry once per distinct formatter
+// and hands the same buffer to all sinks sharing it.
+class LogFormatter {
+public:
+    virtual ~LogFormatter() = default;
+
+    /* Append the rendered entry, including its trailing newline if the format has one.
+     *
+     * \param	LineBuffer	Output, appended to
+     * \param	LogEntry	The entry to render
+     * \param	Logger	The logger, for its style flags and appendLine()
+     */
+    virtual void format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const = 0;
+};
+
+// Only the message and a newline.
+class PlainFormatter : public LogFormatter {
+public:
+    void format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const override;
+};
+
+// An output of the Logger. Sinks are called from logging threads (or the async writer) concurrently,
+// so implementations synchronize themselves.
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+
+    /* Write one or more complete rendered entries.
+     *
+     * \param	char*	Rendered data
+     * \param	size_t	Size of the data
+     * \param	Level	Highest level among the entries
+     */
+    virtual void write(const char* data, size_t size, Level maxLevel) = 0;
+
+    // Sinks that store entries rather than text return true and get writeEntry() instead of write().
+    virtual bool wantsEntries() const { return false; }
+    virtual void writeEntry(const LogEntry& entry) { (void)entry; }
+
+    virtual void flush() { }
+
+    /* Checked before every entry, lets a sink be switched off without removing it.
+     *
+     * \param	LoggerState	The Logger's settings the entry was logged with
+     */
+    virtual bool isActive(const LoggerState& state) const
+    {
+        (void)state;
+        return true;
+    }
+
+    bool accepts(Level level, const LoggerState& state) const
+    {
+        return level >= this->level.load(std::memory_order_relaxed) && isActive(state);
+    }
+
+    /* Only entries at or above this level reach the sink (the Logger level still applies first).
+     *
+     * \param	Level	Minimum level
+     */
+    void setLevel(Level level) { this->level.store(level, std::memory_order_relaxed); }
+    Level getLevel() const { return this->level.load(std::memory_order_relaxed); }
+
+    /* Use a different formatter than the Logger's text line. Set it before the sink is added.
+     *
+     * \param	LogFormatter	The formatter, nullptr for the default text line
+     */
+    void setFormatter(std::shared_ptr<const LogFormatter> formatter) { this->formatter = std::move(formatter); }
+    const LogFormatter* getFormatter() const { return this->formatter.get(); }
+
+protected:
+    std::atomic<Level> level { Level::DEB };
+    std::shared_ptr<const LogFormatter> formatter;
+};
+
+// Appends to a file of its own, so one Logger can feed several files.
+class FileSink : public LogSink {
+public:
+    /* \param	string	File to append to
+     * \param	bool	Remove an existing file first
+     * \param	bool	write(2) after every write() instead of when the buffer fills up
+     */
+    explicit FileSink(const std::string& fileName, bool deleteFile = false, bool flushEveryWrite = true);
+
+    void write(const char* data, size_t size, Level maxLevel) override;
+    void flush() override;
+    bool is_open() const { return file.is_open(); }
+
+private:
+    std::mutex mxFile;
+    LogFile file;
+    bool flushEveryWrite;
+};
+
+// Keeps the most recent entries in memory, e.g. to show them in a status page.
+class RingSink : public LogSink {
+public:
+    /* \param	size_t	Memory budget in bytes, the oldest data is dropped beyond it
+     */
+    explicit RingSink(size_t capacity);
+
+    void write(const char* data, size_t size, Level maxLevel) override;
+
+    /* Copy of the retained data, oldest first. The first line may be cut off.
+     */
+    std::string contents() const;
+
+private:
+    mutable std::mutex mxRing;
+    std::vector<char> ring;
+    size_t head = 0; // next write position
+    bool wrapped = false;
+};
+
+// Connection attempts of a UnixSocketSink without a receiver, in ns.
+#define unixSocketRetryInterval 1000000000
+
+// Sends every write() as one datagram to a Unix domain socket. Never blocks: when the receiver is gone or its
+// buffer is full the data is dropped and counted. A receiver that isn't bound yet, or that went away, is connected
+// to again by write() at most once per unixSocketRetryInterval, everything in between is dropped.
+class UnixSocketSink : public LogSink {
+public:
+    explicit UnixSocketSink(const std::string& socketPath);
+    ~UnixSocketSink() override;
+
+    void write(const char* data, size_t size, Level maxLevel) override;
+
+    // connected to a receiver
+    bool is_open() const { return connected.load(std::memory_order_acquire); }
+    uint64_t getDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    std::string socketPath;
+    int descriptor = -1;
+    std::atomic<bool> connected { false };
+    // steady clock ns of the next connection attempt
+    std::atomic<int64_t> retryAt { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+    bool reconnect();
+};
+
+// Publishes every write() as one record in a POSIX shared memory ring (see LogShm.hpp) for a log shipper
+// in another process, read with LogShmReader or utilis-logshm. Never blocks on the reader: a reader that falls
+// behind is overrun and counts what it lost.
+class ShmSink : public LogSink {
+public:
+    /* \param	string	shm_open() name, "/name"
+     * \param	size_t	Ring capacity in bytes
+     */
+    explicit ShmSink(const std::string& name, size_t capacity = logShmDefaultCapacity);
+
+    void write(const char* data, size_t size, Level maxLevel) override;
+
+    bool is_open() const { return ring.is_open(); }
+
+private:
+    LogShmWriter ring;
+};
+
+#endif // LOG_SINK_HPP
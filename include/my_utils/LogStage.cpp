@@ -0,0 +1,100 @@
+#include "LogStage.hpp"
+#include "LogAlloc.hpp"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+size_t alignEntry(size_t size)
+{
+    return (size + logStageAlign - 1) & ~(size_t)(logStageAlign - 1);
+}
+} // namespace
+
+LogStage::LogStage(size_t capacity)
+{
+    size_t size = 4096;
+    while (size < capacity) {
+        size *= 2;
+    }
+    this->ring = (char*)logMalloc(size);
+    this->mask = size - 1;
+}
+
+LogStage::~LogStage()
+{
+    while (front()) {
+        pop();
+    }
+    logFree(this->ring, this->mask + 1);
+}
+
+size_t LogStage::entrySize(const LogStageEntry& entry)
+{
+    return alignEntry(sizeof(LogStageEntry) + (entry.flags & LOG_STAGE_HEAP ? sizeof(char*) : entry.size));
+}
+
+LogStageEntry* LogStage::reserve(size_t size)
+{
+    size_t capacity = this->mask + 1;
+    size_t needed = alignEntry(sizeof(LogStageEntry) + (size > maxInline() ? sizeof(char*) : size));
+    uint64_t position = this->head.load(std::memory_order_relaxed);
+    size_t offset = position & this->mask;
+    // an entry never wraps, the rest of the ring is skipped instead
+    size_t padding = offset + needed > capacity ? capacity - offset : 0;
+    if (position + padding + needed - this->tail.load(std::memory_order_acquire) > capacity) {
+        return nullptr;
+    }
+    if (padding) {
+        LogStageEntry* pad = (LogStageEntry*)(this->ring + offset);
+        pad->size = (uint32_t)(padding - sizeof(LogStageEntry));
+        pad->flags = LOG_STAGE_PADDING;
+        this->head.store(position + padding, std::memory_order_release);
+        position += padding;
+    }
+    return (LogStageEntry*)(this->ring + (position & this->mask));
+}
+
+void LogStage::commit(LogStageEntry* entry, uint64_t order, uint8_t target, uint8_t level, const char* data, size_t size)
+{
+    entry->order = order;
+    entry->size = (uint32_t)size;
+    entry->target = target;
+    entry->level = level;
+    entry->flags = 0;
+    entry->reserved = 0;
+    char* payload = (char*)(entry + 1);
+    if (size > maxInline()) {
+        char* copy = (char*)logMalloc(size);
+        memcpy(copy, data, size);
+        memcpy(payload, &copy, sizeof(copy));
+        entry->flags = LOG_STAGE_HEAP;
+    } else {
+        memcpy(payload, data, size);
+    }
+    this->head.store(this->head.load(std::memory_order_relaxed) + entrySize(*entry), std::memory_order_release);
+}
+
+const LogStageEntry* LogStage::front()
+{
+    uint64_t end = this->head.load(std::memory_order_acquire);
+    uint64_t position = this->tail.load(std::memory_order_relaxed);
+    while (position != end) {
+        const LogStageEntry* entry = (const LogStageEntry*)(this->ring + (position & this->mask));
+        if (!(entry->flags & LOG_STAGE_PADDING)) {
+            return entry;
+        }
+        position += entrySize(*entry);
+        this->tail.store(position, std::memory_order_release);
+    }
+    return nullptr;
+}
+
+void LogStage::pop()
+{
+    uint64_t position = this->tail.load(std::memory_order_relaxed);
+    const LogStageEntry* entry = (const LogStageEntry*)(this->ring + (position & this->mask));
+    if (entry->flags & LOG_STAGE_HEAP) {
+        logFree((void*)payload(*entry), entry->size);
+    }
+    this->tail.store(position + entrySize(*entry), std::memory_order_release);
+}
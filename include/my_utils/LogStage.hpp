@@ -0,0 +1,113 @@
+#ifndef LOG_STAGE_HPP
+#define LOG_STAGE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define logStageDefaultSize (64 * 1024)
+#define logStageAlign 16
+
+enum LogStageFlags : uint8_t { LOG_STAGE_PADDING = 1, // skip, fills the end of the ring
+    LOG_STAGE_HEAP = 2 }; // the payload is a pointer to a malloc'ed copy of a line too big for the ring
+
+// Header of an entry in a LogStage, the payload follows it.
+struct LogStageEntry {
+    uint64_t order; // what the merger sorts by, a global sequence number or a timestamp
+    uint32_t size; // bytes of the line
+    uint8_t target; // Target::STDOUT or Target::STDERR
+    uint8_t level; // highest Level in the line, for the flush policy
+    uint8_t flags;
+    uint8_t reserved;
+};
+static_assert(sizeof(LogStageEntry) == logStageAlign, "LogStageEntry layout changed");
+
+// A thread's staging buffer for STDOUT/STDERR lines: a single producer, single consumer byte ring.
+// The owning thread appends without locking, the Logger's merger thread takes entries off in order.
+// Lines longer than a quarter of the ring are copied to the heap and only their pointer is queued.
+class LogStage {
+public:
+    /* \param	size_t	Ring size in bytes, rounded up to a power of two
+     */
+    explicit LogStage(size_t capacity = logStageDefaultSize);
+    LogStage(const LogStage&) = delete;
+    LogStage& operator=(const LogStage&) = delete;
+    // frees lines still queued on the heap
+    ~LogStage();
+
+    /* Producer: room for a line of size bytes. Space stays reserved until commit().
+     * Split from commit() so a sequence number can be taken once the line is sure to fit.
+     *
+     * \param	size_t	Bytes of the line
+     * \return	LogStageEntry	Where the entry goes, nullptr if the consumer hasn't freed enough yet
+     */
+    LogStageEntry* reserve(size_t size);
+
+    /* Producer: fill the entry returned by reserve() and publish it.
+     *
+     * \param	LogStageEntry	From reserve(), called with the same size
+     * \param	uint64_t	Merge order
+     * \param	uint8_t	Target
+     * \param	uint8_t	Level
+     * \param	char*	The line
+     * \param	size_t	Bytes of the line
+     */
+    void commit(LogStageEntry* entry, uint64_t order, uint8_t target, uint8_t level, const char* data, size_t size);
+
+    /* Consumer: the oldest entry, padding is skipped.
+     *
+     * \return	LogStageEntry	The entry, nullptr if there is none
+     */
+    const LogStageEntry* front();
+
+    /* Consumer: drop the entry returned by front().
+     */
+    void pop();
+
+    static const char* payload(const LogStageEntry& entry)
+    {
+        const char* data = (const char*)(&entry + 1);
+        return entry.flags & LOG_STAGE_HEAP ? *(char* const*)data : data;
+    }
+
+    /* Visit the entries still queued, oldest first, without removing them.
+     * Takes no locks and doesn't allocate, for the crash handler.
+     *
+     * \param	Visitor	Called with each const LogStageEntry&
+     */
+    template <typename Visitor>
+    void peek(Visitor&& visit) const
+    {
+        uint64_t end = this->head.load(std::memory_order_acquire);
+        for (uint64_t pos = this->tail.load(std::memory_order_acquire); pos < end;) {
+            const LogStageEntry& entry = *(const LogStageEntry*)(this->ring + (pos & this->mask));
+            if (!(entry.flags & LOG_STAGE_PADDING)) {
+                visit(entry);
+            }
+            pos += entrySize(entry);
+        }
+    }
+
+    // Byte positions since the stage was created: everything below produced() was committed,
+    // everything below consumed() was popped. flush() waits for the second to pass the first.
+    uint64_t produced() const { return this->head.load(std::memory_order_acquire); }
+    uint64_t consumed() const { return this->tail.load(std::memory_order_acquire); }
+    bool empty() const { return this->consumed() == this->produced(); }
+
+    // 0 while free, set by the Logger to the token of the thread using it
+    std::atomic<uint64_t> owner { 0 };
+    // set by the owner while it commits a line, Logger::disableStaging() waits for it before the last merge
+    std::atomic<bool> writing { false };
+
+private:
+    char* ring;
+    size_t mask;
+    // producer and consumer positions on their own cache lines
+    alignas(64) std::atomic<uint64_t> head { 0 };
+    alignas(64) std::atomic<uint64_t> tail { 0 };
+
+    size_t maxInline() const { return (this->mask + 1) / 4; }
+    static size_t entrySize(const LogStageEntry& entry);
+};
+
+#endif // LOG_STAGE_HPP
@@ -0,0 +1,233 @@
+#include "LogStructured.hpp"
+#include "Logger.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace {
+// For every byte: 0 to copy it as is, 'u' for a \u00XX escape, otherwise the character after the backslash.
+struct JsonEscapeTable {
+    char escape[256];
+    constexpr JsonEscapeTable()
+        : escape()
+    {
+        for (int c = 0; c < 0x20; c++) {
+            escape[c] = 'u';
+        }
+        escape[(unsigned char)'"'] = '"';
+        escape[(unsigned char)'\\'] = '\\';
+        escape[(unsigned char)'\b'] = 'b';
+        escape[(unsigned char)'\f'] = 'f';
+        escape[(unsigned char)'\n'] = 'n';
+        escape[(unsigned char)'\r'] = 'r';
+        escape[(unsigned char)'\t'] = 't';
+    }
+};
+constexpr JsonEscapeTable jsonEscapeTable;
+const char hexDigits[] = "0123456789abcdef";
+
+// Scratch buffers, one set per thread like the Logger's own.
+struct StructuredState {
+    LineBuffer message;
+    LineBuffer time;
+};
+thread_local StructuredState structuredState;
+
+// The message without the fields, those get their own keys.
+const LineBuffer& renderMessage(const LogEntry& entry)
+{
+    LineBuffer& message = structuredState.message;
+    message.clear();
+    if (entry.format) {
+        formatLogMessage(message, entry.format, entry.args->data(), entry.args->size(), false);
+    } else {
+        message.append(entry.message);
+    }
+    return message;
+}
+
+const LineBuffer& renderTime(const LogEntry& entry, const Logger& logger)
+{
+    LineBuffer& time = structuredState.time;
+    time.clear();
+    logger.appendTimestamp(time, entry.time, entry.state);
+    return time;
+}
+} // namespace
+
+void prepareStructuredThread()
+{
+    structuredState.message.preallocate();
+    structuredState.time.preallocate();
+}
+
+void appendJsonString(LineBuffer& out, const char* str, size_t length)
+{
+    out.reserve(length + 2);
+    out.append('"');
+    const char* run = str;
+    const char* end = str + length;
+    for (const char* c = str; c < end; c++) {
+        char escape = jsonEscapeTable.escape[(unsigned char)*c];
+        if (!escape) {
+            continue;
+        }
+        out.append(run, (size_t)(c - run));
+        if (escape == 'u') {
+            char text[6] = { '\\', 'u', '0', '0', hexDigits[(unsigned char)*c >> 4], hexDigits[*c & 0xf] };
+            out.append(text, sizeof(text));
+        } else {
+            char text[2] = { '\\', escape };
+            out.append(text, sizeof(text));
+        }
+        run = c + 1;
+    }
+    out.append(run, (size_t)(end - run));
+    out.append('"');
+}
+
+void appendJsonValue(LineBuffer& out, const LogArgValue& value)
+{
+    switch (value.type) {
+    case LogArgs::Type::INT:
+    case LogArgs::Type::UINT:
+    case LogArgs::Type::BOOL:
+        appendLogArg(out, value);
+        return;
+    case LogArgs::Type::DOUBLE:
+        if (std::isfinite(value.d)) {
+            appendLogArg(out, value);
+            return;
+        }
+        break;
+    case LogArgs::Type::CHAR:
+        appendJsonString(out, &value.c, 1);
+        return;
+    case LogArgs::Type::STRING:
+    case LogArgs::Type::KEY:
+        appendJsonString(out, value.str, value.length);
+        return;
+    case LogArgs::Type::POINTER:
+        break;
+    }
+    // nan, inf and pointers have no JSON number form
+    out.append('"');
+    appendLogArg(out, value);
+    out.append('"');
+}
+
+void appendLogfmtString(LineBuffer& out, const char* str, size_t length)
+{
+    bool quote = length == 0;
+    for (size_t i = 0; i < length && !quote; i++) {
+        unsigned char c = (unsigned char)str[i];
+        quote = c <= ' ' || c == '=' || c == '"' || c == '\\';
+    }
+    if (!quote) {
+        out.append(str, length);
+        return;
+    }
+    // logfmt has no formal escaping rules, JSON's are what parsers accept
+    appendJsonString(out, str, length);
+}
+
+void JsonFormatter::format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const
+{
+    out.append('{');
+    if (entry.state.timestamp) {
+        const LineBuffer& time = renderTime(entry, logger);
+        out.append("\"time\":", 7);
+        appendJsonString(out, time.data, time.size);
+        out.append(',');
+    }
+    if (entry.state.showLevel) {
+        out.append("\"level\":\"", 9);
+        out.append(levelName(entry.level));
+        out.append("\",", 2);
+    }
+    if (entry.category) {
+        out.append("\"category\":", 11);
+        appendJsonString(out, entry.category, strlen(entry.category));
+        out.append(',');
+    }
+    if (entry.state.fileInfo) {
+        const char* file = entry.location.file_name();
+        const char* function = entry.location.function_name();
+        out.append("\"file\":", 7);
+        appendJsonString(out, file, strlen(file));
+        out.append(",\"line\":", 8);
+        out.append((unsigned int)entry.location.line());
+        out.append(",\"function\":", 12);
+        appendJsonString(out, function, strlen(function));
+        out.append(',');
+    }
+
+    const LineBuffer& message = renderMessage(entry);
+    out.append("\"msg\":", 6);
+    appendJsonString(out, message.data, message.size);
+
+    if (entry.args) {
+        LogArgsReader reader(entry.args->data(), entry.args->size());
+        LogArgValue key;
+        LogArgValue value;
+        while (reader.nextField(key, value)) {
+            out.append(',');
+            appendJsonString(out, key.str, key.length);
+            out.append(':');
+            appendJsonValue(out, value);
+        }
+    }
+    out.append("}\n", 2);
+}
+
+void LogfmtFormatter::format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const
+{
+    if (entry.state.timestamp) {
+        const LineBuffer& time = renderTime(entry, logger);
+        out.append("time=", 5);
+        appendLogfmtString(out, time.data, time.size);
+        out.append(' ');
+    }
+    if (entry.state.showLevel) {
+        out.append("level=", 6);
+        out.append(levelName(entry.level));
+        out.append(' ');
+    }
+    if (entry.category) {
+        out.append("category=", 9);
+        appendLogfmtString(out, entry.category, strlen(entry.category));
+        out.append(' ');
+    }
+    if (entry.state.fileInfo) {
+        const char* function = entry.location.function_name();
+        out.append("file=", 5);
+        out.append(entry.location.file_name());
+        out.append(':');
+        out.append((unsigned int)entry.location.line());
+        out.append(" function=", 10);
+        appendLogfmtString(out, function, strlen(function));
+        out.append(' ');
+    }
+
+    const LineBuffer& message = renderMessage(entry);
+    out.append("msg=", 4);
+    appendLogfmtString(out, message.data, message.size);
+
+    if (entry.args) {
+        LogArgsReader reader(entry.args->data(), entry.args->size());
+        LogArgValue key;
+        LogArgValue value;
+        while (reader.nextField(key, value)) {
+            out.append(' ');
+            out.append(key.str, key.length);
+            out.append('=');
+            if (value.type == LogArgs::Type::STRING) {
+                appendLogfmtString(out, value.str, value.length);
+            } else if (value.type == LogArgs::Type::CHAR) {
+                appendLogfmtString(out, &value.c, 1);
+            } else {
+                appendLogArg(out, value);
+            }
+        }
+    }
+    out.append('\n');
+}
@@ -0,0 +1,46 @@
+#ifndef LOG_STRUCTURED_HPP
+#define LOG_STRUCTURED_HPP
+
+#include "LineBuffer.hpp"
+#include "LogFormat.hpp"
+#include "LogSink.hpp"
+#include <cstddef>
+
+// Formatters for kv() fields, set them on a sink with LogSink::setFormatter().
+// Both follow the timestamp/level/file info flags of the LoggerState like the text line does.
+
+// One JSON object per line:
+// {"time":"...","level":"INFO","file":"a.cpp","line":12,"function":"main","msg":"order","id":42,"ms":3.5}
+class JsonFormatter : public LogFormatter {
+public:
+    void format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const override;
+};
+
+// logfmt: time=... level=INFO file=a.cpp:12 function=main msg=order id=42 ms=3.5
+class LogfmtFormatter : public LogFormatter {
+public:
+    void format(LineBuffer& out, const LogEntry& entry, const Logger& logger) const override;
+};
+
+/* Append a quoted JSON string. Characters that need no escaping are copied in runs.
+ * Bytes >= 0x80 are passed through, so the output is valid UTF-8 if the input is.
+ *
+ * \param	LineBuffer	Output, appended to
+ * \param	char*	The string
+ * \param	size_t	Its length
+ */
+void appendJsonString(LineBuffer& out, const char* str, size_t length);
+
+/* Append one argument as a JSON value (numbers and booleans bare, everything else as a string).
+ */
+void appendJsonValue(LineBuffer& out, const LogArgValue& value);
+
+/* Append a logfmt value, quoted only if it contains spaces, '=', quotes or control characters.
+ */
+void appendLogfmtString(LineBuffer& out, const char* str, size_t length);
+
+/* Allocate the calling thread's scratch buffers now, see Logger::prepareThread().
+ */
+void prepareStructuredThread();
+
+#endif // LOG_STRUCTURED_HPP
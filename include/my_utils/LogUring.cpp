@@ -0,0 +1,299 @@
+#include "LogUring.hpp"
+#include "LogAlloc.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+} // namespace
+
+LogUring::LogUring(unsigned int depth)
+    : depth(std::max(depth, 1u))
+{
+    this->slots.resize(this->depth);
+    if (!setup()) {
+        teardown();
+    }
+}
+
+LogUring::~LogUring()
+{
+    drain();
+    teardown();
+    for (Slot& slot : this->slots) {
+        logFree(slot.data, slot.capacity);
+    }
+    for (auto& buffer : this->freeBuffers) {
+        logFree(buffer.first, buffer.second);
+    }
+}
+
+bool LogUring::setup()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    long fd = syscall(__NR_io_uring_setup, this->depth, &params);
+    if (fd < 0) {
+        return false;
+    }
+    this->ringFd = (int)fd;
+
+    this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // since 5.4 both rings live in one mapping
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        this->sqRingSize = this->cqRingSize = std::max(this->sqRingSize, this->cqRingSize);
+    }
+    void* ring = mmap(nullptr, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd,
+        IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    this->sqRing = ring;
+    if (single) {
+        this->cqRing = ring;
+    } else {
+        ring = mmap(nullptr, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd,
+            IORING_OFF_CQ_RING);
+        if (ring == MAP_FAILED) {
+            return false;
+        }
+        this->cqRing = ring;
+    }
+    this->sqeArraySize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring = mmap(nullptr, this->sqeArraySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ringFd,
+        IORING_OFF_SQES);
+    if (ring == MAP_FAILED) {
+        return false;
+    }
+    this->sqeArray = ring;
+
+    char* sq = (char*)this->sqRing;
+    char* cq = (char*)this->cqRing;
+    this->sqHead = (unsigned*)(sq + params.sq_off.head);
+    this->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    this->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    this->sqIndices = (unsigned*)(sq + params.sq_off.array);
+    this->cqHead = (unsigned*)(cq + params.cq_off.head);
+    this->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    this->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    this->cqes = cq + params.cq_off.cqes;
+    // the ring may have been rounded up, never keep more in flight than asked for
+    this->depth = std::min(this->depth, params.sq_entries);
+    return true;
+}
+
+void LogUring::teardown()
+{
+    if (this->sqeArray) {
+        munmap(this->sqeArray, this->sqeArraySize);
+    }
+    if (this->cqRing && this->cqRing != this->sqRing) {
+        munmap(this->cqRing, this->cqRingSize);
+    }
+    if (this->sqRing) {
+        munmap(this->sqRing, this->sqRingSize);
+    }
+    this->sqeArray = this->cqRing = this->sqRing = nullptr;
+    if (this->ringFd >= 0) {
+        close(this->ringFd);
+        this->ringFd = -1;
+    }
+}
+
+bool LogUring::enter(unsigned int toSubmit, unsigned int minComplete)
+{
+    unsigned int flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        long result = syscall(__NR_io_uring_enter, this->ringFd, toSubmit, minComplete, flags, nullptr, 0);
+        this->counters.enterCalls++;
+        if (result >= 0) {
+            return true;
+        }
+        if (errno == EAGAIN) {
+            // out of kernel resources for the moment
+            sched_yield();
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+char* LogUring::submit(int fd, char* buffer, size_t size, uint64_t offset, size_t capacity)
+{
+    if (!isKernelRing()) {
+        writeFallback(fd, buffer, size, offset);
+        return buffer;
+    }
+    // recycle what already completed, no syscall
+    reap(0);
+    if (this->pending == this->depth) {
+        reap(1);
+        if (!isKernelRing()) {
+            writeFallback(fd, buffer, size, offset);
+            return buffer;
+        }
+    }
+
+    size_t index = 0;
+    while (this->slots[index].busy) {
+        index++;
+    }
+    Slot& slot = this->slots[index];
+    logFree(slot.data, slot.capacity);
+    slot.data = buffer;
+    slot.capacity = capacity;
+    slot.size = size;
+    slot.offset = offset;
+    slot.fd = fd;
+    slot.busy = true;
+
+    unsigned tail = *this->sqTail;
+    unsigned position = tail & *this->sqMask;
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*)this->sqeArray + position;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = (uint32_t)size;
+    sqe->off = offset;
+    sqe->user_data = index;
+    this->sqIndices[position] = position;
+    __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    slot.submittedAt = nowNs();
+    this->pending++;
+    this->counters.maxInFlight = std::max(this->counters.maxInFlight, this->pending);
+    this->counters.submissions++;
+    bool submitted = enter(1, 0);
+    this->counters.submitLatency.record((uint64_t)(nowNs() - slot.submittedAt));
+    if (!submitted) {
+        abandon();
+    }
+    return takeFreeBuffer(capacity);
+}
+
+void LogUring::reap(unsigned int minComplete)
+{
+    if (this->ringFd < 0) {
+        return;
+    }
+    unsigned int reaped = 0;
+    for (;;) {
+        unsigned head = *this->cqHead;
+        unsigned tail = __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe& cqe = ((const struct io_uring_cqe*)this->cqes)[head & *this->cqMask];
+            complete(this->slots[cqe.user_data], cqe.res);
+            reaped++;
+        }
+        __atomic_store_n(this->cqHead, head, __ATOMIC_RELEASE);
+        if (reaped >= minComplete || this->pending == 0) {
+            return;
+        }
+        if (!enter(0, 1)) {
+            abandon();
+            return;
+        }
+    }
+}
+
+void LogUring::complete(Slot& slot, int64_t result)
+{
+    if (!slot.busy) {
+        // abandoned, already written synchronously
+        return;
+    }
+    this->counters.completions++;
+    this->counters.completionLatency.record((uint64_t)(nowNs() - slot.submittedAt));
+    if (result == -EINVAL || result == -EOPNOTSUPP) {
+        // kernel older than 5.6, no IORING_OP_WRITE
+        this->fallback = true;
+        writeFallback(slot.fd, slot.data, slot.size, slot.offset);
+    } else if (result == -EAGAIN || result == -EINTR) {
+        writeFallback(slot.fd, slot.data, slot.size, slot.offset);
+    } else if (result < 0) {
+        this->counters.errors++;
+    } else {
+        this->counters.bytesWritten += (uint64_t)result;
+        if ((size_t)result < slot.size) {
+            this->counters.shortWrites++;
+            writeFallback(slot.fd, slot.data + result, slot.size - (size_t)result, slot.offset + (uint64_t)result);
+        }
+    }
+    slot.busy = false;
+    this->pending--;
+    this->freeBuffers.emplace_back(slot.data, slot.capacity);
+    slot.data = nullptr;
+}
+
+void LogUring::abandon()
+{
+    this->counters.errors++;
+    this->fallback = true;
+    for (Slot& slot : this->slots) {
+        if (!slot.busy) {
+            continue;
+        }
+        // the same bytes at the same offset, harmless if the kernel still writes them too
+        writeFallback(slot.fd, slot.data, slot.size, slot.offset);
+        // the kernel may still read the buffer, leak it
+        slot.data = nullptr;
+        slot.busy = false;
+    }
+    this->pending = 0;
+}
+
+void LogUring::drain()
+{
+    // keeps reaping after a fallback, the kernel may still be using the buffers
+    while (this->pending > 0) {
+        reap(this->pending);
+    }
+}
+
+void LogUring::writeFallback(int fd, const char* data, size_t size, uint64_t offset)
+{
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, (off_t)offset);
+        this->counters.fallbackWrites++;
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            this->counters.errors++;
+            return;
+        }
+        this->counters.bytesWritten += (uint64_t)written;
+        data += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+}
+
+char* LogUring::takeFreeBuffer(size_t capacity)
+{
+    if (this->freeBuffers.empty()) {
+        return (char*)logMalloc(capacity);
+    }
+    auto buffer = this->freeBuffers.back();
+    this->freeBuffers.pop_back();
+    if (buffer.second < capacity) {
+        logFree(buffer.first, buffer.second);
+        return (char*)logMalloc(capacity);
+    }
+    return buffer.first;
+}
@@ -0,0 +1,111 @@
+#ifndef LOG_URING_HPP
+#define LOG_URING_HPP
+
+#include "LatencyHistogram.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Counters of a LogUring. Latencies are in nanoseconds.
+struct LogUringStats {
+    uint64_t submissions = 0; // buffers handed to the kernel
+    uint64_t enterCalls = 0; // io_uring_enter(2) syscalls
+    uint64_t completions = 0;
+    uint64_t shortWrites = 0; // completions that wrote less than asked, the rest was pwrite'd
+    uint64_t errors = 0; // writes that failed for good
+    uint64_t fallbackWrites = 0; // pwrite(2) calls made instead of a submission
+    uint64_t bytesWritten = 0;
+    unsigned int maxInFlight = 0;
+    LatencyHistogram submitLatency; // time spent in io_uring_enter(2) to submit
+    LatencyHistogram completionLatency; // submission until the completion was reaped
+};
+
+// Writes buffers at explicit offsets through an io_uring, several in flight at once.
+// Talks to the kernel with raw syscalls, no liburing needed. If the ring can't be set up (old kernel,
+// io_uring disabled by sysctl or seccomp) or the kernel rejects the write opcode, every buffer is
+// written with pwrite(2) instead and submit() simply returns it.
+// Buffers are malloc'ed and change hands: submit() takes one and returns another one that has completed.
+// Not thread safe, LogFile calls it under the Logger's lock.
+class LogUring {
+public:
+#define logUringDefaultDepth 8
+    /* \param	unsigned	Maximum writes in flight
+     */
+    explicit LogUring(unsigned int depth = logUringDefaultDepth);
+    LogUring(const LogUring&) = delete;
+    LogUring& operator=(const LogUring&) = delete;
+    ~LogUring();
+
+    /* Whether writes really go through io_uring.
+     */
+    bool isKernelRing() const { return this->ringFd >= 0 && !this->fallback; }
+
+    /* Start writing a buffer. Waits for a completion if depth writes are already in flight.
+     *
+     * \param	int	File descriptor
+     * \param	char*	malloc'ed buffer, owned by the LogUring from now on
+     * \param	size_t	Bytes to write
+     * \param	uint64_t	File offset
+     * \param	size_t	Capacity of the buffer
+     * \return	char*	A free malloc'ed buffer of at least the same capacity, owned by the caller
+     */
+    char* submit(int fd, char* buffer, size_t size, uint64_t offset, size_t capacity);
+
+    /* Wait until everything submitted has completed.
+     */
+    void drain();
+
+    unsigned int inFlight() const { return this->pending; }
+    const LogUringStats& stats() const { return this->counters; }
+
+private:
+    struct Slot {
+        char* data = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;
+        uint64_t offset = 0;
+        int fd = -1;
+        int64_t submittedAt = 0;
+        bool busy = false;
+    };
+
+    int ringFd = -1;
+    unsigned int depth;
+    unsigned int pending = 0;
+    std::vector<Slot> slots;
+    // completed buffers and their capacity
+    std::vector<std::pair<char*, size_t>> freeBuffers;
+    // the kernel rejected IORING_OP_WRITE or the ring failed, everything goes through pwrite(2)
+    bool fallback = false;
+    LogUringStats counters;
+
+    // mapped rings
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    void* sqeArray = nullptr;
+    size_t sqeArraySize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqIndices = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    void* cqes = nullptr;
+
+    bool setup();
+    void teardown();
+    bool enter(unsigned int toSubmit, unsigned int minComplete);
+    // reap whatever completed, waiting for at least minComplete
+    void reap(unsigned int minComplete);
+    void complete(Slot& slot, int64_t result);
+    // the ring stopped accepting calls: rewrite what is in flight synchronously and leave the ring alone
+    void abandon();
+    void writeFallback(int fd, const char* data, size_t size, uint64_t offset);
+    char* takeFreeBuffer(size_t capacity);
+};
+
+#endif // LOG_URING_HPP
@@ -1,175 +1,1804 @@
 #include "Logger.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cerrno>
+#include <csignal>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <mutex>
 #include <stdio.h>
+#include <stdio_ext.h>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 
+using std::chrono::steady_clock;
 using std::chrono::system_clock;
 
 // TODO use string_view?
 Logger logger;
 
-void Logger::setTarget(Target target) { this->LoggerTarget = (short)target; }
-void Logger::xorTarget(Target target) { this->LoggerTarget ^= (short)target; }
-void Logger::orTarget(Target target) { this->LoggerTarget |= (short)target; }
+// distinct formatters rendered per record, sinks beyond that share the last slot and re-render
+#define logMaxFormatters 8
 
-void Logger::setLevel(Level level) { this->LoggerLevel = level; }
+namespace {
+// Scratch state for assembling lines, one per thread so formatting runs in parallel.
+struct FormatState {
+    LineBuffer info;
+    LineBuffer line;
+    LineBuffer message;
+    LineBuffer rendered[logMaxFormatters];
+    // this can speed up time stamp aquisition by 75%
+    // the date/time part only changes once a second, the fraction is appended per line
+    int64_t lastSecond = INT64_MIN;
+    short lastMode = -1;
+    char timeStr[64];
+    size_t timeStrSize = 0;
+};
+thread_local FormatState formatState;
 
-Level Logger::getLevel() const { return this->LoggerLevel; }
+// The staging buffer a thread appends to, see Logger::enableStaging(). Given back when the thread exits.
+struct StageHandle {
+    uint64_t session = 0;
+    uint64_t token = 0;
+    std::shared_ptr<LogStage> stage;
+
+    void release()
+    {
+        if (this->stage) {
+            uint64_t owner = this->token;
+            this->stage->owner.compare_exchange_strong(owner, 0);
+            this->stage.reset();
+        }
+    }
+    ~StageHandle() { release(); }
+};
+thread_local StageHandle stageHandle;
+// unique across Loggers, a handle from another Logger or an earlier enableStaging() never matches
+std::atomic<uint64_t> stagingSessions { 0 };
+std::atomic<uint64_t> stageTokens { 0 };
+
+// Built-in targets in the order of Logger::targetSinks.
+const Target builtinTargets[] = { Target::STDOUT, Target::STDERR, Target::LOG_FILE, Target::LOG_BINARY, Target::LOG_MMAP };
+#define logBinarySinkIndex 3
+
+void renderEntry(LineBuffer& out, const LogFormatter* formatter, const LogEntry& entry, const Logger& logger)
+{
+    if (formatter) {
+        formatter->format(out, entry, logger);
+    } else {
+        logger.appendLine(out, entry.level, entry.message, entry.location, entry.time, entry.category, &entry.state);
+    }
+}
+
+// Render an entry with a formatter unless an earlier sink already did, returns the rendered text.
+const LineBuffer& renderOnce(const LogFormatter* (&rendered)[logMaxFormatters], size_t& renderedCount,
+    const LogFormatter* formatter, const LogEntry& entry, const Logger& logger)
+{
+    size_t slot = 0;
+    while (slot < renderedCount && rendered[slot] != formatter) {
+        slot++;
+    }
+    LineBuffer& out = formatState.rendered[slot < logMaxFormatters ? slot : logMaxFormatters - 1];
+    if (slot == renderedCount) {
+        if (slot == logMaxFormatters) {
+            slot--;
+        } else {
+            renderedCount++;
+        }
+        rendered[slot] = formatter;
+        out.clear();
+        renderEntry(out, formatter, entry, logger);
+    }
+    return out;
+}
+} // namespace
+
+// Adapter that routes a built-in target through the sink interface, the target bit switches it on and off.
+class Logger::TargetSink : public LogSink {
+public:
+    TargetSink(Logger* owner, Target target)
+        : owner(owner)
+        , target(target)
+    {
+    }
+
+    void write(const char* data, size_t size, Level maxLevel) override
+    {
+        this->owner->writeTarget(this->target, data, size, maxLevel);
+    }
+
+    // LOG_BINARY stores the arguments instead of the rendered line
+    bool wantsEntries() const override { return this->target == Target::LOG_BINARY; }
+    void writeEntry(const LogEntry& entry) override
+    {
+        this->owner->writeBinary(
+            entry.state, entry.level, entry.time, entry.location, entry.message, entry.format, entry.args);
+    }
+
+    bool isActive(const LoggerState& state) const override { return state.targets & (short)this->target; }
+
+private:
+    Logger* owner;
+    Target target;
+};
+
+Logger::Logger()
+{
+    LoggerState initial;
+    initial.level = DEFAULT_LOG_LEVEL
+    initial.fileInfo = DEFAULT_ENABLE_FILE_INFO
+    this->state.store(initial.pack(), std::memory_order_relaxed);
+    this->stdoutStream.attach(STDOUT_FILENO);
+    this->stderrStream.attach(STDERR_FILENO);
+    this->stdoutInteractive = isatty(STDOUT_FILENO);
+    auto list = std::make_unique<SinkList>();
+    for (size_t i = 0; i < sizeof(builtinTargets) / sizeof(builtinTargets[0]); i++) {
+        this->targetSinks[i] = std::make_shared<TargetSink>(this, builtinTargets[i]);
+        list->sinks.push_back(this->targetSinks[i]);
+    }
+    publishSinks(std::move(list));
+}
+
+void Logger::publishSinks(std::unique_ptr<SinkList> list)
+{
+    this->sinkList.store(list.get(), std::memory_order_release);
+    this->sinkLists.push_back(std::move(list));
+}
+
+void Logger::addSink(std::shared_ptr<LogSink> sink)
+{
+    if (!sink) {
+        return;
+    }
+    std::scoped_lock<std::mutex> lock(mxSinks);
+    auto list = std::make_unique<SinkList>(*this->sinkList.load(std::memory_order_relaxed));
+    list->sinks.push_back(std::move(sink));
+    publishSinks(std::move(list));
+    this->extraSinks.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Logger::removeSink(const std::shared_ptr<LogSink>& sink)
+{
+    std::scoped_lock<std::mutex> lock(mxSinks);
+    for (const auto& targetSink : this->targetSinks) {
+        if (targetSink == sink) {
+            return false;
+        }
+    }
+    auto list = std::make_unique<SinkList>(*this->sinkList.load(std::memory_order_relaxed));
+    auto found = std::find(list->sinks.begin(), list->sinks.end(), sink);
+    if (found == list->sinks.end()) {
+        return false;
+    }
+    list->sinks.erase(found);
+    publishSinks(std::move(list));
+    this->extraSinks.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::shared_ptr<LogSink> Logger::getTargetSink(Target target) const
+{
+    for (size_t i = 0; i < sizeof(builtinTargets) / sizeof(builtinTargets[0]); i++) {
+        if (builtinTargets[i] == target) {
+            return this->targetSinks[i];
+        }
+    }
+    return nullptr;
+}
+
+void Logger::setTarget(Target target)
+{
+    updateState([target](LoggerState& state) { state.targets = (short)target; });
+}
+void Logger::xorTarget(Target target)
+{
+    updateState([target](LoggerState& state) { state.targets ^= (short)target; });
+}
+void Logger::orTarget(Target target)
+{
+    updateState([target](LoggerState& state) { state.targets |= (short)target; });
+}
+
+void Logger::setLevel(Level level)
+{
+    updateState([level](LoggerState& state) { state.level = level; });
+}
+
+Level Logger::getLevel() const { return this->getState().level; }
+
+void Logger::setState(LoggerState next, const std::vector<std::pair<string, Level>>& categoryLevels)
+{
+    // created up front, category() takes mxCategories
+    std::vector<LogCategory*> staged;
+    for (const auto& entry : categoryLevels) {
+        staged.push_back(&this->category(entry.first));
+    }
+    {
+        std::scoped_lock<std::mutex> lock(mxState);
+        next.generation = (uint16_t)(LoggerState::unpack(this->state.load(std::memory_order_relaxed)).generation + 1);
+        // the categories switch when a record carries the new generation, i.e. with the store below
+        for (size_t i = 0; i < staged.size(); i++) {
+            staged[i]->stageLevel(categoryLevels[i].second, next.generation);
+        }
+        this->state.store(next.pack(), std::memory_order_release);
+    }
+    for (LogCategory* category : staged) {
+        category->updateThreshold();
+    }
+}
 
 string Logger::levelToString(Level level) const { return levelMap.at(level); }
 
 short Logger::setFile(const string& fileName, bool deleteFile, const std::experimental::source_location location)
 {
-    if (!(this->LoggerTarget & (short)Target::LOG_FILE)) {
+    if (!(this->getState().targets & (short)Target::LOG_FILE)) {
         this->xorTarget(Target::LOG_FILE);
     }
-    if (this->LoggingFileStream.is_open()) {
-        this->LoggingFileStream.close();
+    return reopenFile(fileName, ofstream::app, deleteFile, location);
+}
+
+short Logger::setBinaryFile(const string& fileName, bool deleteFile, const std::experimental::source_location location)
+{
+    bool opened;
+    {
+        std::scoped_lock<std::mutex> lock(mxLog);
+        opened = this->binaryLog.open(fileName, deleteFile);
     }
-    // Make sure we can open the file for writing
+    if (!opened) {
+        this->write(Level::ERR, ("Failed to open binary Logger file '" + fileName + "'").c_str(), location);
+        return 1;
+    }
+    this->orTarget(Target::LOG_BINARY);
+    return 0;
+}
+
+short Logger::setMmapFile(
+    const string& fileName, bool deleteFile, size_t chunkSize, const std::experimental::source_location location)
+{
     if (deleteFile) {
         remove(fileName.c_str());
     }
-    this->LoggingFileStream.open(fileName, ofstream::app);
-    if (!this->LoggingFileStream.is_open()) {
-        // Logger the failure and return an error code
-        this->write(Level::ERR, ("Failed to open Logger file '" + fileName + "'").c_str(), location);
+    if (!this->mmapFile.open(fileName, chunkSize)) {
+        this->write(Level::ERR, ("Failed to open mmap Logger file '" + fileName + "'").c_str(), location);
         return 1;
     }
-    this->LoggerFile = fileName;
+    this->LoggerMmapFile = fileName;
+    this->orTarget(Target::LOG_MMAP);
     return 0;
 }
 
 short Logger::setFile(
     const string& fileName, ofstream::openmode mode, bool deleteFile, const std::experimental::source_location location)
 {
+    return reopenFile(fileName, mode, deleteFile, location);
+}
+
+short Logger::reopenFile(
+    const string& fileName, ofstream::openmode mode, bool deleteFile, const std::experimental::source_location& location)
+{
+    {
+        // other threads may be writing to the old file, e.g. when LoggerConfig reloads a new path
+        std::scoped_lock<std::mutex> lock(mxLog);
+        if (this->LoggingFileStream.is_open()) {
+            this->LoggingFileStream.close();
+        }
+        // Make sure we can open the file for writing
+        if (deleteFile) {
+            remove(fileName.c_str());
+        }
+        this->LoggingFileStream.open(fileName, mode);
+        if (this->LoggingFileStream.is_open()) {
+            this->LoggerFile = fileName;
+            resetFileStats();
+            if (logFixedCapacity.load(std::memory_order_relaxed)) {
+                this->LoggingFileStream.allocateBuffer();
+            }
+        }
+    }
     if (this->LoggingFileStream.is_open()) {
-        this->LoggingFileStream.close();
+        if (logFixedCapacity.load(std::memory_order_relaxed)) {
+            prepareThread();
+        }
+        return 0;
     }
-    if (deleteFile) {
-        remove(fileName.c_str());
+    // Logger the failure and return an error code, outside the lock write() takes
+    this->write(Level::ERR, ("Failed to open Logger file '" + fileName + "'").c_str(), location);
+    return 1;
+}
+
+bool Logger::switchFileIfChanged(const string& fileName)
+{
+    {
+        std::scoped_lock<std::mutex> lock(mxLog);
+        if (fileName == this->LoggerFile && this->LoggingFileStream.is_open()) {
+            return true;
+        }
+        bool wasOpen = this->LoggingFileStream.is_open();
+        if (wasOpen) {
+            this->LoggingFileStream.close();
+        }
+        this->LoggingFileStream.open(fileName, ofstream::app);
+        if (!this->LoggingFileStream.is_open()) {
+            if (wasOpen) {
+                this->LoggingFileStream.open(this->LoggerFile, ofstream::app);
+            }
+            return false;
+        }
+        this->LoggerFile = fileName;
+        resetFileStats();
+        if (logFixedCapacity.load(std::memory_order_relaxed)) {
+            this->LoggingFileStream.allocateBuffer();
+        }
     }
-    this->LoggingFileStream.open(fileName, mode);
-    if (!this->LoggingFileStream.is_open()) {
-        // Logger the failure and return an error code
-        this->write(Level::ERR, ("Failed to open Logger file '" + fileName + "'").c_str(), location);
-        return 1;
+    if (logFixedCapacity.load(std::memory_order_relaxed)) {
+        prepareThread();
     }
-    this->LoggerFile = fileName;
-    return 0;
+    return true;
+}
+
+bool Logger::prepareWrite(const LoggerState& state)
+{
+    // Target::DISABLED takes precedence over other targets, sinks added with addSink() still get the message
+    if (state.targets == (short)Target::DISABLED && this->extraSinks.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    if (state.targets & (short)Target::LOG_FILE && !this->LoggingFileStream.is_open()) {
+        setFile(this->LoggerFile);
+    }
+    return true;
 }
 
 void Logger::write(Level level, const char* message, const std::experimental::source_location location)
 {
+    writeRecord(nullptr, level, message, nullptr, nullptr, location);
+}
+
+void Logger::writeFormat(Level level, const char* format, LogArgs& args, const std::experimental::source_location location)
+{
+    writeRecord(nullptr, level, nullptr, format, &args, location);
+}
+
+void Logger::writeRecord(const LogCategory* category, Level level, const char* message, const char* format,
+    LogArgs* args, const std::experimental::source_location& location)
+{
+    // one snapshot of the settings for the whole record
+    LoggerState state = this->getState();
     // Only log if we're at or above the pre-defined severity
-    if (level < this->LoggerLevel) {
+    Level minLevel = category ? category->levelAt(state.generation) : state.level;
+    const char* categoryName = category ? category->name.c_str() : nullptr;
+    if (level < minLevel) {
+        if (level >= this->flightRecorderLevel.load(std::memory_order_relaxed)) {
+            int64_t time = state.timestamp ? this->timestampNow(state.timestampMode) : 0;
+            this->flightRecorder->record(level, time, location, message, format, args, categoryName);
+        }
         return;
     }
-    // Target::DISABLED takes precedence over other targets
-    if (this->LoggerTarget == (short)Target::DISABLED) {
+    if (this->rateLimited.load(std::memory_order_relaxed) && level < this->rateLimit.unlimitedLevel) {
+        const LogCallSite* site = this->cacheCallSites ? logCallSite(location) : nullptr;
+        if (site && !admit(*site, message, format, args, category)) {
+            return;
+        }
+    }
+    deliver(state, categoryName, level, message, format, args, location);
+}
+
+void Logger::deliver(const LoggerState& state, const char* categoryName, Level level, const char* message,
+    const char* format, LogArgs* args, const std::experimental::source_location& location)
+{
+    if (!prepareWrite(state)) {
         return;
     }
-    size_t offset = 0;
-    if (this->LoggerTarget & (short)Target::LOG_FILE && !this->LoggingFileStream.is_open()) {
-        setFile(this->LoggerFile);
+    if (this->flightRecorder && level >= this->flightTriggerLevel) {
+        dumpFlightRecorder();
+    }
+
+    int64_t time = state.timestamp ? this->timestampNow(state.timestampMode) : 0;
+    if (this->asyncQueue) {
+        // formatting is left to the writer thread
+        LogRecord record;
+        record.level = level;
+        record.time = time;
+        record.location = location;
+        record.category = categoryName;
+        record.state = state;
+        if (format) {
+            record.format = format;
+            record.args = std::move(*args);
+        } else {
+            record.message = message;
+        }
+        enqueue(record);
+        return;
+    }
+
+    LogEntry entry;
+    entry.level = level;
+    entry.time = time;
+    entry.location = location;
+    entry.category = categoryName;
+    entry.state = state;
+    if (format) {
+        entry.format = format;
+        entry.args = args;
+    } else {
+        entry.message = message;
+    }
+    dispatch(entry);
+}
+
+#pragma region rate limit
+static uint64_t messageHash(const char* message, const char* format, const LogArgs* args)
+{
+    // FNV-1a, a format call is identified by its format string and argument bytes
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 0x100000001b3ull;
+        }
+    };
+    if (format) {
+        mix(reinterpret_cast<const uint8_t*>(&format), sizeof(format));
+        mix(args->data(), args->size());
+    } else {
+        mix(reinterpret_cast<const uint8_t*>(message), strlen(message));
+    }
+    return hash;
+}
+
+void Logger::setRateLimit(const LogRateLimit& limit)
+{
+    stopRateReporter();
+    this->rateLimit = limit;
+    this->rateIntervalNs = limit.perSecond > 0 ? (int64_t)(1e9 / limit.perSecond) : 0;
+    this->rateToleranceNs = this->rateIntervalNs * (int64_t)(std::max(limit.burst, 1u) - 1);
+    this->rateSuppressed = 0;
+    if (limit.enabled() && !this->rateSites) {
+        this->rateSites = std::make_unique<RateSite[]>(logCallSiteTableSize);
+    } else if (this->rateSites) {
+        // the array stays, a thread that saw the old limit may still be using it
+        for (size_t slot = 0; slot < logCallSiteTableSize; slot++) {
+            RateSite& rate = this->rateSites[slot];
+            rate.tat = 0;
+            rate.suppressed = 0;
+            rate.lastHash = 0;
+            rate.repeats = 0;
+        }
+    }
+    this->rateLimited = limit.enabled();
+    if (limit.enabled() && limit.reportInterval.count() > 0) {
+        this->rateReporterRunning = true;
+        this->rateReporter = std::thread(&Logger::rateReporterLoop, this);
+    }
+}
+
+bool Logger::admit(const LogCallSite& site, const char* message, const char* format, const LogArgs* args,
+    const LogCategory* category)
+{
+    RateSite& rate = this->rateSites[site.slot];
+    rate.category.store(category, std::memory_order_relaxed);
+    if (this->rateLimit.collapseRepeats) {
+        uint64_t hash = messageHash(message, format, args);
+        if (rate.lastHash.exchange(hash, std::memory_order_relaxed) == hash) {
+            rate.repeats.fetch_add(1, std::memory_order_relaxed);
+            this->rateSuppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    if (this->rateIntervalNs) {
+        // GCRA: a token bucket kept as the time the bucket will be full again
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        int64_t tat = rate.tat.load(std::memory_order_relaxed);
+        do {
+            if (tat - now > this->rateToleranceNs) {
+                rate.suppressed.fetch_add(1, std::memory_order_relaxed);
+                this->rateSuppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!rate.tat.compare_exchange_weak(
+            tat, std::max(tat, now) + this->rateIntervalNs, std::memory_order_relaxed));
+    }
+    // repeats are reported before the next different message so the note follows the message it refers to
+    if (rate.repeats.load(std::memory_order_relaxed)
+        || (this->rateLimit.reportInterval.count() == 0 && rate.suppressed.load(std::memory_order_relaxed))) {
+        reportSite(site, rate);
+    }
+    return true;
+}
+
+void Logger::reportSite(const LogCallSite& site, RateSite& rate)
+{
+    uint64_t repeats = rate.repeats.exchange(0, std::memory_order_relaxed);
+    uint64_t suppressed = rate.suppressed.exchange(0, std::memory_order_relaxed);
+    if (!repeats && !suppressed) {
+        return;
+    }
+    // the reports are WARNING messages of the site's category and filtered like any other
+    LoggerState state = this->getState();
+    const LogCategory* category = rate.category.load(std::memory_order_relaxed);
+    if (Level::WARNING < (category ? category->levelAt(state.generation) : state.level)) {
+        return;
+    }
+    const char* categoryName = category ? category->name.c_str() : nullptr;
+    auto location = std::experimental::source_location::current(site.file, site.function, site.line, site.column);
+    char text[96];
+    if (repeats) {
+        size_t size = cpyChar(text, "last message repeated ");
+        size += formatUnsigned(text + size, repeats);
+        cpyChar(text + size, " times");
+        deliver(state, categoryName, Level::WARNING, text, nullptr, nullptr, location);
+    }
+    if (suppressed) {
+        size_t size = cpyChar(text, "rate limit suppressed ");
+        size += formatUnsigned(text + size, suppressed);
+        cpyChar(text + size, " messages");
+        deliver(state, categoryName, Level::WARNING, text, nullptr, nullptr, location);
+    }
+}
+
+void Logger::reportSuppressed()
+{
+    if (!this->rateSites) {
+        return;
+    }
+    for (size_t slot = 0; slot < logCallSiteTableSize; slot++) {
+        RateSite& rate = this->rateSites[slot];
+        if (rate.repeats.load(std::memory_order_relaxed) || rate.suppressed.load(std::memory_order_relaxed)) {
+            const LogCallSite* site = logCallSiteAt(slot);
+            if (site) {
+                reportSite(*site, rate);
+            }
+        }
+    }
+}
+
+void Logger::stopRateReporter()
+{
+    {
+        std::scoped_lock<std::mutex> lock(mxRateReporter);
+        if (!this->rateReporterRunning) {
+            return;
+        }
+        this->rateReporterRunning = false;
+    }
+    cvRateReporter.notify_one();
+    this->rateReporter.join();
+    // whatever is still pending
+    reportSuppressed();
+}
+
+void Logger::rateReporterLoop()
+{
+    std::unique_lock<std::mutex> lock(mxRateReporter);
+    while (this->rateReporterRunning) {
+        cvRateReporter.wait_for(lock, this->rateLimit.reportInterval);
+        if (!this->rateReporterRunning) {
+            break;
+        }
+        lock.unlock();
+        reportSuppressed();
+        lock.lock();
+    }
+}
+#pragma endregion rate limit
+
+#pragma region categories
+LogCategory::LogCategory(Logger& owner, const string& name, Level level)
+    : owner(owner)
+    , name(name)
+    , levels(0)
+    , threshold(level)
+{
+    setLevel(level);
+}
+
+void LogCategory::setLevel(Level level)
+{
+    // in effect for any generation, the level before it is never used
+    this->levels.store((uint64_t)(uint8_t)level << 16 | (uint64_t)(uint8_t)level << 24, std::memory_order_release);
+    updateThreshold();
+}
+
+void LogCategory::stageLevel(Level level, uint16_t generation)
+{
+    Level previous = this->levelAt((uint16_t)(generation - 1));
+    this->levels.store(generation | (uint64_t)(uint8_t)level << 16 | (uint64_t)(uint8_t)previous << 24,
+        std::memory_order_release);
+    // records of both generations may still come through isEnabled() until updateThreshold()
+    this->threshold.store(std::min(std::min(level, previous), this->owner.flightRecorderLevel.load(std::memory_order_relaxed)),
+        std::memory_order_relaxed);
+}
+
+void LogCategory::updateThreshold()
+{
+    uint64_t word = this->levels.load(std::memory_order_acquire);
+    uint16_t generation = (uint16_t)word;
+    // once the Logger is past the generation the old level is dropped, levelAt() stays right after wrap around
+    if ((int16_t)(this->owner.getState().generation - generation) >= 0) {
+        uint64_t settled = (uint64_t)generation | (word & 0xff0000) | (word & 0xff0000) << 8;
+        // a level staged meanwhile wins
+        if (this->levels.compare_exchange_strong(word, settled, std::memory_order_acq_rel)) {
+            word = settled;
+        }
+    }
+    this->threshold.store(std::min(std::min((Level)((word >> 16) & 0xff), (Level)((word >> 24) & 0xff)),
+                              this->owner.flightRecorderLevel.load(std::memory_order_relaxed)),
+        std::memory_order_relaxed);
+}
+
+void LogCategory::write(Level level, const char* message, const std::experimental::source_location location)
+{
+    if (this->isEnabled(level)) {
+        this->owner.writeRecord(this, level, message, nullptr, nullptr, location);
+    }
+}
+
+LogCategory& Logger::category(const string& name)
+{
+    std::scoped_lock<std::mutex> lock(mxCategories);
+    for (const auto& category : this->categories) {
+        if (category->name == name) {
+            return *category;
+        }
+    }
+    this->categories.push_back(std::make_unique<LogCategory>(*this, name, this->getLevel()));
+    return *this->categories.back();
+}
+
+void Logger::updateCategoryThresholds()
+{
+    std::scoped_lock<std::mutex> lock(mxCategories);
+    for (const auto& category : this->categories) {
+        category->updateThreshold();
+    }
+}
+#pragma endregion categories
+
+void Logger::enableFlightRecorder(size_t memoryBudget, Level triggerLevel, size_t dumpCount, Level captureLevel)
+{
+    this->flightRecorderLevel = Level::EMERG;
+    this->flightRecorder = std::make_unique<LogFlightRecorder>(memoryBudget);
+    this->flightTriggerLevel = triggerLevel;
+    this->flightDumpCount = dumpCount;
+    this->flightRecorderLevel = captureLevel;
+    updateCategoryThresholds();
+}
+
+void Logger::disableFlightRecorder()
+{
+    this->flightRecorderLevel = Level::EMERG;
+    updateCategoryThresholds();
+}
+
+void Logger::dumpFlightRecorder()
+{
+    if (!this->flightRecorder) {
+        return;
+    }
+    LogArgs args;
+    this->flightRecorder->drain(this->flightDumpCount, [&](const LogFlightRecord& captured) {
+        LogEntry entry;
+        entry.level = (Level)captured.level;
+        entry.time = captured.time;
+        entry.location = captured.location;
+        entry.category = captured.category;
+        if (captured.format) {
+            args.assign(captured.payload, captured.size, captured.argCount);
+            entry.format = captured.format;
+            entry.args = &args;
+        } else {
+            entry.message = (const char*)captured.payload;
+        }
+        if (!this->asyncQueue) {
+            dispatch(entry);
+            return;
+        }
+        // keep the order with records already queued
+        LogRecord record;
+        record.level = entry.level;
+        record.time = entry.time;
+        record.location = entry.location;
+        record.category = entry.category;
+        if (entry.format) {
+            record.format = entry.format;
+            record.args = std::move(args);
+        } else {
+            record.message = entry.message;
+        }
+        enqueue(record);
+    });
+}
+
+#pragma region crash handler
+namespace {
+#define crashLineCapacity (64 * 1024)
+#define crashStackSize (64 * 1024)
+const int crashSignals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+struct sigaction previousCrashActions[sizeof(crashSignals) / sizeof(crashSignals[0])];
+std::atomic<Logger*> crashLogger { nullptr };
+std::atomic<int> crashState { 0 }; // 1 while a thread drains, 2 once it is done
+char* crashStack = nullptr;
+
+const char* crashSignalName(int signal)
+{
+    switch (signal) {
+    case SIGSEGV:
+        return "SIGSEGV";
+    case SIGBUS:
+        return "SIGBUS";
+    case SIGILL:
+        return "SIGILL";
+    case SIGFPE:
+        return "SIGFPE";
+    case SIGABRT:
+        return "SIGABRT";
+    }
+    return "signal";
+}
+
+// yyyy-mm-ddThh:mm:ss.uuuuuuZ without gmtime_r, which isn't async signal safe
+void appendCrashTime(LineBuffer& out, int64_t time, bool elapsed)
+{
+    int64_t seconds = time >= 0 ? time / 1000000000 : (time - 999999999) / 1000000000;
+    uint64_t micros = (uint64_t)(time - seconds * 1000000000) / 1000;
+    char text[numberFormatMaxChars * 2];
+    size_t length = 0;
+    if (elapsed) {
+        text[length++] = '+';
+        length += formatSigned(text + length, seconds);
+    } else {
+        // days to civil date, see howardhinnant.github.io/date_algorithms.html
+        int64_t days = seconds >= 0 ? seconds / 86400 : (seconds - 86399) / 86400;
+        int64_t secondOfDay = seconds - days * 86400;
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        int64_t dayOfEra = days - era * 146097;
+        int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+        int64_t day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+        int64_t month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+        int64_t year = yearOfEra + era * 400 + (month <= 2);
+        length += formatPadded(text + length, (uint64_t)year, 4);
+        text[length++] = '-';
+        length += formatPadded(text + length, (uint64_t)month, 2);
+        text[length++] = '-';
+        length += formatPadded(text + length, (uint64_t)day, 2);
+        text[length++] = 'T';
+        length += formatPadded(text + length, (uint64_t)(secondOfDay / 3600), 2);
+        text[length++] = ':';
+        length += formatPadded(text + length, (uint64_t)(secondOfDay / 60 % 60), 2);
+        text[length++] = ':';
+        length += formatPadded(text + length, (uint64_t)(secondOfDay % 60), 2);
+    }
+    text[length++] = '.';
+    length += formatPadded(text + length, micros, 6);
+    if (!elapsed) {
+        text[length++] = 'Z';
+    }
+    out.append(text, length);
+}
+} // namespace
+
+void Logger::installCrashHandler()
+{
+    this->crashLine.reserve(crashLineCapacity);
+    if (!crashStack) {
+        // a stack overflow leaves no room to run the handler on the thread's own stack
+        crashStack = (char*)malloc(crashStackSize);
+        stack_t stack;
+        stack.ss_sp = crashStack;
+        stack.ss_size = crashStackSize;
+        stack.ss_flags = 0;
+        sigaltstack(&stack, nullptr);
+    }
+    Logger* previous = crashLogger.exchange(this);
+    if (previous) {
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &Logger::crashHandler;
+    action.sa_flags = SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < sizeof(crashSignals) / sizeof(crashSignals[0]); i++) {
+        sigaction(crashSignals[i], &action, &previousCrashActions[i]);
+    }
+}
+
+void Logger::removeCrashHandler()
+{
+    Logger* self = this;
+    if (!crashLogger.compare_exchange_strong(self, nullptr)) {
+        return;
+    }
+    for (size_t i = 0; i < sizeof(crashSignals) / sizeof(crashSignals[0]); i++) {
+        sigaction(crashSignals[i], &previousCrashActions[i], nullptr);
+    }
+}
+
+void Logger::crashHandler(int signal)
+{
+    Logger* owner = crashLogger.load();
+    int expected = 0;
+    if (owner && crashState.compare_exchange_strong(expected, 1)) {
+        int savedErrno = errno;
+        owner->drainForCrash(signal);
+        errno = savedErrno;
+        crashState.store(2);
+    } else {
+        // another thread crashed first, give it time to finish writing
+        struct timespec pause = { 0, 1000000 };
+        for (int i = 0; i < 5000 && crashState.load() == 1; i++) {
+            nanosleep(&pause, nullptr);
+        }
+    }
+    for (size_t i = 0; i < sizeof(crashSignals) / sizeof(crashSignals[0]); i++) {
+        if (crashSignals[i] != signal) {
+            continue;
+        }
+        struct sigaction previous = previousCrashActions[i];
+        // an ignored fault would just fault again
+        if (previous.sa_handler == SIG_IGN) {
+            previous.sa_handler = SIG_DFL;
+        }
+        sigaction(signal, &previous, nullptr);
+    }
+    // blocked until the handler returns, then delivered to the previous handler
+    raise(signal);
+}
+
+void Logger::drainForCrash(int signal)
+{
+    // buffered data is older than anything still queued
+    this->stdoutStream.flushFromSignal();
+    this->stderrStream.flushFromSignal();
+    this->LoggingFileStream.flushFromSignal();
+
+    // staged lines come next, one thread after the other instead of merged
+    size_t stages = this->stageCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < stages; i++) {
+        this->stageStorage[i]->peek([&](const LogStageEntry& entry) {
+            LogFile& stream = entry.target == (uint8_t)Target::STDERR ? this->stderrStream : this->stdoutStream;
+            stream.writeFromSignal(LogStage::payload(entry), entry.size);
+        });
     }
 
+    if (this->flightRecorder) {
+        this->flightRecorder->drain(this->flightDumpCount, [&](const LogFlightRecord& captured) {
+            appendCrashRecord((Level)captured.level, captured.time, &captured.location, captured.category,
+                (const char*)captured.payload, captured.format, captured.payload, captured.size);
+            writeCrashLine();
+        });
+    }
+    if (this->asyncQueue) {
+        this->asyncQueue->peek([&](const LogRecord& record) {
+            appendCrashRecord(record.level, record.time, &record.location, record.category, record.message.c_str(),
+                record.format, record.args.data(), record.args.size());
+            writeCrashLine();
+        });
+    }
+
+    char text[64] = "fatal signal ";
+    size_t length = strlen(text);
+    length += formatSigned(text + length, signal);
+    text[length++] = ' ';
+    text[length++] = '(';
+    const char* name = crashSignalName(signal);
+    memcpy(text + length, name, strlen(name));
+    length += strlen(name);
+    text[length++] = ')';
+    text[length] = '\0';
+    appendCrashRecord(Level::EMERG, this->timestampNow(), nullptr, nullptr, text, nullptr, nullptr, 0);
+    writeCrashLine();
+}
+
+void Logger::appendCrashRecord(Level level, int64_t time, const std::experimental::source_location* location,
+    const char* category, const char* message, const char* format, const uint8_t* args, size_t argsSize)
+{
+    LineBuffer& out = this->crashLine;
+    out.clear();
+    // never grow the buffer, everything variable is cut to what is left
+    auto room = [&out] { return out.capacity > out.size + 256 ? out.capacity - out.size - 256 : 0; };
+
+    out.append('[');
+    appendCrashTime(out, time, this->getState().timestampMode == TimestampMode::ELAPSED);
+    out.append("] ", 2);
+    out.append(levelName(level));
+    if (category) {
+        out.append(' ');
+        out.append(category, std::min(strlen(category), room()));
+    }
+    if (location) {
+        const char* file = location->file_name();
+        out.append(' ');
+        out.append(file, std::min(strlen(file), room()));
+        out.append(':');
+        out.append((unsigned int)location->line());
+    }
+    out.append(": ", 2);
+    if (!format) {
+        out.append(message, std::min(strlen(message), room()));
+    } else if (strlen(format) + argsSize * 4 < room()) {
+        // no argument renders to more than 4 characters per packed byte
+        formatLogMessage(out, format, args, argsSize);
+    } else {
+        out.append(format, std::min(strlen(format), room()));
+    }
+    out.append('\n');
+}
+
+void Logger::writeCrashLine()
+{
+    short targets = this->getState().targets;
+    if (targets & (short)Target::STDOUT) {
+        this->stdoutStream.writeFromSignal(this->crashLine.data, this->crashLine.size);
+    }
+    if (targets & (short)Target::STDERR) {
+        this->stderrStream.writeFromSignal(this->crashLine.data, this->crashLine.size);
+    }
+    if (targets & (short)Target::LOG_FILE) {
+        this->LoggingFileStream.writeFromSignal(this->crashLine.data, this->crashLine.size);
+    }
+}
+#pragma endregion crash handler
+
+void Logger::dispatch(LogEntry& entry)
+{
+    const SinkList* list = this->sinkList.load(std::memory_order_acquire);
+    const LogSink* binarySink = this->targetSinks[logBinarySinkIndex].get();
+
+    // the message body is shared by every formatter, LOG_BINARY alone doesn't need it
+    if (entry.format) {
+        for (const auto& sink : list->sinks) {
+            if (sink.get() != binarySink && sink->accepts(entry.level, entry.state)) {
+                LineBuffer& message = formatState.message;
+                message.clear();
+                formatLogMessage(message, entry.format, entry.args->data(), entry.args->size());
+                entry.message = message.c_str();
+                break;
+            }
+        }
+    }
+
+    const LogFormatter* rendered[logMaxFormatters];
+    size_t renderedCount = 0;
+    for (const auto& sink : list->sinks) {
+        if (!sink->accepts(entry.level, entry.state)) {
+            continue;
+        }
+        if (sink->wantsEntries()) {
+            sink->writeEntry(entry);
+            continue;
+        }
+        const LineBuffer& line = renderOnce(rendered, renderedCount, sink->getFormatter(), entry, *this);
+        sink->write(line.data, line.size, entry.level);
+    }
+}
+
+void Logger::writeBinary(const LoggerState& state, Level level, int64_t time,
+    const std::experimental::source_location& location, const char* message, const char* format, const LogArgs* args)
+{
+    uint8_t flags = (state.timestamp ? BINARY_TIMESTAMP : 0) | (state.showLevel ? BINARY_LEVEL : 0)
+        | (state.fileInfo ? BINARY_FILE_INFO : 0) | ((uint8_t)state.timestampPrecision << BINARY_PRECISION_SHIFT)
+        | ((uint8_t)state.timestampMode << BINARY_MODE_SHIFT);
+    std::scoped_lock<std::mutex> lock(mxLog);
+    if (format) {
+        this->binaryLog.write((uint8_t)level, flags, time, location, format, args->data(), args->size(), args->count());
+    } else {
+        this->binaryLog.writeMessage((uint8_t)level, flags, time, location, message);
+    }
+}
+
+const LineBuffer& Logger::formatLine(
+    Level level, const char* message, const std::experimental::source_location location, int64_t time) const
+{
+    LineBuffer& line = formatState.line;
+    line.clear();
+    appendLine(line, level, message, location, time);
+    return line;
+}
+
+void Logger::appendLine(LineBuffer& out, Level level, const char* message,
+    const std::experimental::source_location location, int64_t time, const char* category,
+    const LoggerState* state) const
+{
+    LoggerState current = state ? *state : this->getState();
     // Append the message to our Logger statement
-    if (this->fileEnabled || this->timestampEnabled || this->levelEnabled) {
-        getLoggerfunctionInfo(level, location);
+    if (current.fileInfo || current.timestamp || current.showLevel || category) {
+        appendFunctionInfo(out, current, level, location, time, category);
+        out.append(":\n", 2);
     }
+    out.append(message);
+    out.append('\n');
+}
 
-    if (loggerMessageSize < loggerFunctionInfoStringSize + strlen(message) + 10) {
-        loggerMessageSize = loggerFunctionInfoStringSize + strlen(message) + 10;
-        free(loggerMessageString);
-        loggerMessageString = (char*)malloc(sizeof(char) * loggerMessageSize);
+void Logger::writeTarget(Target target, const char* data, size_t size, Level maxLevel)
+{
+    if ((target == Target::STDOUT || target == Target::STDERR) && this->isStaging()
+        && stageLine(target, data, size, maxLevel)) {
+        return;
     }
-    if (this->fileEnabled || this->timestampEnabled || this->levelEnabled) {
-        offset += cpyChar(loggerMessageString, loggerFunctionInfoString);
-        offset += cpyChar(loggerMessageString + offset, ":\n");
+
+    if (target == Target::STDOUT) {
+        std::scoped_lock<std::mutex> lock(mxLog);
+        writeStreamLocked(this->stdoutStream, stdout, data, size, maxLevel);
     }
-    offset += cpyChar(loggerMessageString + offset, message);
-    offset += cpyChar(loggerMessageString + offset, "\n");
 
-    // printf makes printing a bit faster
-    // Logger to stdout if it's one of our targets
-    if ((this->LoggerTarget & (short)Target::STDOUT)) {
+    if (target == Target::STDERR) {
         std::scoped_lock<std::mutex> lock(mxLog);
-        fprintf(stdout, "%s", loggerMessageString);
+        writeStreamLocked(this->stderrStream, stderr, data, size, maxLevel);
     }
 
-    // Logger to stderr if it's one of our targets
-    if ((this->LoggerTarget & (short)Target::STDERR)) {
+    // Logger to a file if we've set a LoggerFile
+    if (target == Target::LOG_FILE && this->LoggerFile != "") {
         std::scoped_lock<std::mutex> lock(mxLog);
-        fprintf(stderr, "%s", loggerMessageString);
+        // rotate between writes so a line (or async batch) never spans two files
+        if (this->rotation.enabled() && this->fileBytes > 0
+            && ((this->rotation.maxBytes && this->fileBytes + size > this->rotation.maxBytes)
+                || (this->rotation.maxAge.count()
+                    && steady_clock::now() - this->fileOpenedAt >= this->rotation.maxAge))) {
+            rotateLocked();
+        }
+        this->LoggingFileStream.write(data, size);
+        this->fileBytes += size;
+        if (shouldFlushLocked(this->LoggingFileStream, maxLevel, this->flushPolicy.everyLine)) {
+            flushFileLocked();
+        }
+    }
+
+    // the mapping takes care of its own concurrency, mxLog is only needed to rotate it
+    if (target == Target::LOG_MMAP) {
+        if (this->rotation.maxBytes && this->mmapFile.size() > 0
+            && this->mmapFile.size() + size > this->rotation.maxBytes) {
+            std::scoped_lock<std::mutex> lock(mxLog);
+            if (this->mmapFile.size() + size > this->rotation.maxBytes) {
+                rotateMmapLocked();
+            }
+        }
+        // reported once per file, through STDERR since the formatting buffers are still in use
+        if (!this->mmapFile.write(data, size) && this->mmapFile.getDropped() == 1) {
+            string message = "Logger: could not map more of '" + this->LoggerMmapFile + "', dropping LOG_MMAP lines\n";
+            writeTarget(Target::STDERR, message.data(), message.size(), Level::ERR);
+        }
     }
+}
+
+void Logger::resetFileStats()
+{
+    struct stat fileStat;
+    this->fileBytes = stat(this->LoggerFile.c_str(), &fileStat) == 0 ? (size_t)fileStat.st_size : 0;
+    this->fileOpenedAt = steady_clock::now();
+}
+
+void Logger::setRotation(const LogRotation& rotation)
+{
+    std::scoped_lock<std::mutex> lock(mxLog);
+    this->rotation = rotation;
+}
 
-    // Logger to a file if it's one of our targets and we've set a LoggerFile
-    if ((this->LoggerTarget & (short)Target::LOG_FILE) && this->LoggerFile != "") {
+void Logger::rotateFile()
+{
+    std::scoped_lock<std::mutex> lock(mxLog);
+    if (this->LoggingFileStream.is_open()) {
+        rotateLocked();
+    }
+}
+
+void Logger::rotateLocked()
+{
+    // only a rename and a reopen here, the rotator thread renumbers and compresses
+    string segment = this->LoggerFile + ".rotating." + std::to_string(getpid()) + "." + std::to_string(this->rotationCount++);
+    this->LoggingFileStream.close();
+    if (rename(this->LoggerFile.c_str(), segment.c_str()) == 0) {
+        this->rotator.submit(segment, this->LoggerFile, this->rotation);
+    }
+    this->LoggingFileStream.open(this->LoggerFile, ofstream::app);
+    this->fileBytes = 0;
+    this->fileOpenedAt = steady_clock::now();
+}
+
+void Logger::rotateMmapLocked()
+{
+    string segment
+        = this->LoggerMmapFile + ".rotating." + std::to_string(getpid()) + "." + std::to_string(this->rotationCount++);
+    // close() truncates to the real length before the rename
+    size_t chunkSize = this->mmapFile.getChunkSize();
+    this->mmapFile.close();
+    if (rename(this->LoggerMmapFile.c_str(), segment.c_str()) == 0) {
+        this->rotator.submit(segment, this->LoggerMmapFile, this->rotation);
+    }
+    this->mmapFile.open(this->LoggerMmapFile, chunkSize);
+}
+
+void Logger::enableAsync(size_t capacity, OverflowPolicy policy)
+{
+    if (this->asyncQueue) {
+        this->disableAsync();
+    }
+    this->asyncPolicy = policy;
+    this->asyncWritten = 0;
+    this->asyncDropped = 0;
+    this->asyncQueue = std::make_unique<LogQueue<LogRecord>>(capacity);
+    this->asyncRunning = true;
+    this->asyncWriter = std::thread(&Logger::asyncWriterLoop, this);
+}
+
+void Logger::disableAsync()
+{
+    if (!this->asyncQueue) {
+        return;
+    }
+    {
+        std::scoped_lock<std::mutex> lock(mxAsync);
+        this->asyncRunning = false;
+    }
+    cvAsyncWork.notify_one();
+    if (this->asyncWriter.joinable()) {
+        this->asyncWriter.join();
+    }
+    this->asyncQueue.reset();
+}
+
+void Logger::flush()
+{
+    if (this->asyncQueue) {
+        // by position, not by count: a record another thread is still pushing ahead of ours doesn't count for ours
+        uint64_t target = this->asyncQueue->pushed();
+        std::unique_lock<std::mutex> lock(mxAsync);
+        cvAsyncWork.notify_one();
+        cvAsyncDone.wait(lock, [&] { return this->asyncWritten.load(std::memory_order_acquire) >= target; });
+    }
+    if (this->isStaging()) {
+        // the async writer above stages its lines too, so this comes second
+        size_t count = this->stageCount.load(std::memory_order_acquire);
+        std::vector<uint64_t> produced(count);
+        for (size_t i = 0; i < count; i++) {
+            produced[i] = this->stageStorage[i]->produced();
+        }
+        std::unique_lock<std::mutex> lock(mxStage);
+        cvStageWork.notify_one();
+        cvStageDone.wait(lock, [&] {
+            for (size_t i = 0; i < count; i++) {
+                if (this->stageStorage[i] && this->stageStorage[i]->consumed() < produced[i]) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+    {
+        std::scoped_lock<std::mutex> lock(mxLog);
+        flushStreamLocked(this->stdoutStream, stdout);
+        flushStreamLocked(this->stderrStream, stderr);
+        fflush(stdout);
+        fflush(stderr);
+        flushFileLocked();
+        this->binaryLog.flush();
+    }
+    for (const auto& sink : this->sinkList.load(std::memory_order_acquire)->sinks) {
+        sink->flush();
+    }
+}
+
+void Logger::flushFileLocked()
+{
+    this->LoggingFileStream.flush();
+    // lines too big for the buffer bypass it, they still need the fsync
+    if (this->flushPolicy.fsync && this->LoggingFileStream.unsyncedBytes()) {
+        this->LoggingFileStream.sync();
+    }
+}
+
+bool Logger::shouldFlushLocked(const LogFile& stream, Level maxLevel, bool everyLine) const
+{
+    return everyLine || maxLevel >= this->flushPolicy.flushLevel
+        || (this->flushPolicy.maxBufferedBytes && stream.buffered() >= this->flushPolicy.maxBufferedBytes);
+}
+
+void Logger::writeStreamLocked(LogFile& stream, FILE* stdioStream, const char* data, size_t size, Level maxLevel)
+{
+    // whatever the program printed since the last line is newer than what is buffered here
+    if (__fpending(stdioStream)) {
+        flushStreamLocked(stream, stdioStream);
+    }
+    stream.write(data, size);
+    bool everyLine = this->flushPolicy.everyLine && (&stream == &this->stderrStream || this->stdoutInteractive);
+    if (shouldFlushLocked(stream, maxLevel, everyLine)) {
+        flushStreamLocked(stream, stdioStream);
+    }
+}
+
+void Logger::flushStreamLocked(LogFile& stream, FILE* stdioStream)
+{
+    if (stream.buffered()) {
+        stream.flush();
+    }
+    if (__fpending(stdioStream)) {
+        fflush(stdioStream);
+    }
+}
+
+void Logger::setFlushPolicy(const LogFlushPolicy& policy)
+{
+    stopFlushTimer();
+    {
         std::scoped_lock<std::mutex> lock(mxLog);
-        this->LoggingFileStream << loggerMessageString;
-        this->LoggingFileStream.flush();
+        this->flushPolicy = policy;
+        // the buffer has to hold at least one flush worth of data
+        if (policy.maxBufferedBytes > logFileDefaultBufferSize) {
+            this->LoggingFileStream.setBufferSize(policy.maxBufferedBytes);
+            this->stdoutStream.setBufferSize(policy.maxBufferedBytes);
+            this->stderrStream.setBufferSize(policy.maxBufferedBytes);
+        }
+        flushStreamLocked(this->stdoutStream, stdout);
+        flushStreamLocked(this->stderrStream, stderr);
+        flushFileLocked();
     }
+    if (policy.interval.count() > 0) {
+        this->flushTimerRunning = true;
+        this->flushTimer = std::thread(&Logger::flushTimerLoop, this);
+    }
+}
+
+LogFileStats Logger::getFileStats()
+{
+    std::scoped_lock<std::mutex> lock(mxLog);
+    return this->LoggingFileStream.stats();
 }
 
+bool Logger::setFileUring(unsigned int depth)
+{
+    std::scoped_lock<std::mutex> lock(mxLog);
+    return this->LoggingFileStream.setUring(depth);
+}
+
+LogUringStats Logger::getUringStats()
+{
+    std::scoped_lock<std::mutex> lock(mxLog);
+    const LogUring* uring = this->LoggingFileStream.uringBackend();
+    return uring ? uring->stats() : LogUringStats();
+}
+
+LogFileStats Logger::getStreamStats(Target target)
+{
+    std::scoped_lock<std::mutex> lock(mxLog);
+    return target == Target::STDERR ? this->stderrStream.stats() : this->stdoutStream.stats();
+}
+
+void Logger::stopFlushTimer()
+{
+    {
+        std::scoped_lock<std::mutex> lock(mxFlushTimer);
+        this->flushTimerRunning = false;
+    }
+    cvFlushTimer.notify_one();
+    if (this->flushTimer.joinable()) {
+        this->flushTimer.join();
+    }
+}
+
+void Logger::flushTimerLoop()
+{
+    std::unique_lock<std::mutex> timerLock(mxFlushTimer);
+    while (this->flushTimerRunning) {
+        cvFlushTimer.wait_for(timerLock, this->flushPolicy.interval);
+        std::scoped_lock<std::mutex> lock(mxLog);
+        flushStreamLocked(this->stdoutStream, stdout);
+        flushStreamLocked(this->stderrStream, stderr);
+        flushFileLocked();
+    }
+}
+
+void Logger::enqueue(LogRecord& record)
+{
+    LogQueue<LogRecord>& queue = *this->asyncQueue;
+    while (!queue.tryPush(record)) {
+        if (this->asyncPolicy == OverflowPolicy::DROP_NEWEST) {
+            this->asyncDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (this->asyncPolicy == OverflowPolicy::DROP_OLDEST) {
+            LogRecord evicted;
+            if (queue.tryPop(evicted)) {
+                this->asyncDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+        // BLOCK, make sure the writer is awake and give it time to drain
+        cvAsyncWork.notify_one();
+        std::this_thread::yield();
+    }
+    if (this->asyncWriterSleeping.load(std::memory_order_acquire)) {
+        cvAsyncWork.notify_one();
+    }
+}
+
+void Logger::asyncWriterLoop()
+{
+    LogQueue<LogRecord>& queue = *this->asyncQueue;
+    LogRecord record;
+    // one batch per formatter and sink level in use, sinks sharing both get the same buffer
+    struct Batch {
+        const LogFormatter* formatter = nullptr;
+        Level level = Level::DEB;
+        Level maxLevel = Level::DEB;
+        LineBuffer data;
+    };
+    std::vector<Batch> batches;
+    const LogSink* binarySink = this->targetSinks[logBinarySinkIndex].get();
+    // set when the record was popped but belongs to the next batch
+    bool pending = false;
+    size_t position = 0;
+    for (;;) {
+        if (!pending) {
+            pending = queue.tryPop(record, &position);
+        }
+        // a batch goes to the targets of its first record, one logged under other targets starts the next batch
+        const LoggerState batchState = record.state;
+        const SinkList* list = this->sinkList.load(std::memory_order_acquire);
+        size_t batchCount = 0;
+        for (const auto& sink : list->sinks) {
+            if (!pending || sink->wantsEntries() || !sink->isActive(batchState)) {
+                continue;
+            }
+            size_t i = 0;
+            while (i < batchCount
+                && (batches[i].formatter != sink->getFormatter() || batches[i].level != sink->getLevel())) {
+                i++;
+            }
+            if (i == batchCount) {
+                if (batchCount == batches.size()) {
+                    batches.emplace_back();
+                }
+                batches[i].formatter = sink->getFormatter();
+                batches[i].level = sink->getLevel();
+                batches[i].maxLevel = Level::DEB;
+                batches[i].data.clear();
+                batchCount++;
+            }
+        }
+
+        size_t count = 0;
+        uint64_t written = 0;
+        while (pending && record.state.targets == batchState.targets) {
+            LogEntry entry;
+            entry.level = record.level;
+            entry.time = record.time;
+            entry.location = record.location;
+            entry.message = record.message.c_str();
+            entry.category = record.category;
+            entry.state = record.state;
+            if (record.format) {
+                entry.format = record.format;
+                entry.args = &record.args;
+                bool needsMessage = false;
+                for (size_t i = 0; i < batchCount && !needsMessage; i++) {
+                    needsMessage = record.level >= batches[i].level;
+                }
+                for (const auto& sink : list->sinks) {
+                    if (needsMessage) {
+                        break;
+                    }
+                    needsMessage = sink->wantsEntries() && sink.get() != binarySink && sink->accepts(record.level, record.state);
+                }
+                if (needsMessage) {
+                    LineBuffer& formatted = formatState.message;
+                    formatted.clear();
+                    formatLogMessage(formatted, record.format, record.args.data(), record.args.size());
+                    entry.message = formatted.c_str();
+                }
+            }
+
+            const LogFormatter* rendered[logMaxFormatters];
+            size_t renderedCount = 0;
+            for (size_t i = 0; i < batchCount; i++) {
+                Batch& batch = batches[i];
+                if (record.level < batch.level) {
+                    continue;
+                }
+                const LineBuffer& line = renderOnce(rendered, renderedCount, batch.formatter, entry, *this);
+                batch.data.append(line.data, line.size);
+                if (record.level > batch.maxLevel) {
+                    batch.maxLevel = record.level;
+                }
+            }
+            for (const auto& sink : list->sinks) {
+                if (sink->wantsEntries() && sink->accepts(record.level, record.state)) {
+                    sink->writeEntry(entry);
+                }
+            }
+            count++;
+            // positions below are written or were evicted by a producer
+            written = position + 1;
+            pending = count < asyncBatchSize && queue.tryPop(record, &position);
+        }
+        if (count) {
+            // one write (and one flush) per sink for the whole batch
+            for (const auto& sink : list->sinks) {
+                if (sink->wantsEntries() || !sink->isActive(batchState)) {
+                    continue;
+                }
+                for (size_t i = 0; i < batchCount; i++) {
+                    if (batches[i].formatter == sink->getFormatter() && batches[i].level == sink->getLevel()) {
+                        if (batches[i].data.size) {
+                            sink->write(batches[i].data.data, batches[i].data.size, batches[i].maxLevel);
+                        }
+                        break;
+                    }
+                }
+            }
+            this->asyncWritten.store(written, std::memory_order_release);
+            std::scoped_lock<std::mutex> lock(mxAsync);
+            cvAsyncDone.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mxAsync);
+        if (!this->asyncRunning && queue.empty()) {
+            break;
+        }
+        // the timeout covers a producer that pushed right before we announced we were going to sleep
+        this->asyncWriterSleeping.store(true, std::memory_order_release);
+        if (queue.empty()) {
+            cvAsyncDone.notify_all();
+            cvAsyncWork.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        this->asyncWriterSleeping.store(false, std::memory_order_relaxed);
+    }
+    std::scoped_lock<std::mutex> lock(mxAsync);
+    cvAsyncDone.notify_all();
+}
+
+#pragma region staging
+void Logger::enableStaging(StagingOrder order, size_t bufferSize)
+{
+    if (this->isStaging()) {
+        this->disableStaging();
+    }
+    this->stagingOrder = order;
+    this->stageSize = bufferSize;
+    this->stageSequence = 0;
+    this->stageNext = 0;
+    this->stageMergerRunning = true;
+    this->stageMerger = std::thread(&Logger::stageMergerLoop, this);
+    this->stagingSession.store(stagingSessions.fetch_add(1) + 1, std::memory_order_release);
+}
+
+void Logger::disableStaging()
+{
+    if (!this->isStaging()) {
+        return;
+    }
+    this->stagingSession.store(0, std::memory_order_seq_cst);
+    {
+        std::scoped_lock<std::mutex> lock(mxStage);
+        this->stageMergerRunning = false;
+    }
+    cvStageWork.notify_one();
+    if (this->stageMerger.joinable()) {
+        this->stageMerger.join();
+    }
+    // lines committed by threads that got their stage before the session ended, a thread still writing
+    // may be waiting for room so the stages are merged while waiting for it
+    for (;;) {
+        bool writing = false;
+        for (size_t i = 0; i < this->stageCount.load(std::memory_order_acquire); i++) {
+            writing = writing || this->stageStorage[i]->writing.load(std::memory_order_seq_cst);
+        }
+        while (mergeStages(this->stageNext)) {
+        }
+        if (!writing) {
+            break;
+        }
+        std::this_thread::yield();
+    }
+    // threads still holding a stage keep it alive until they notice the session changed
+    std::scoped_lock<std::mutex> lock(mxStage);
+    for (size_t i = 0; i < this->stageCount.load(std::memory_order_relaxed); i++) {
+        this->stageStorage[i].reset();
+    }
+    this->stageCount.store(0, std::memory_order_release);
+}
+
+LogStage* Logger::threadStage()
+{
+    uint64_t session = this->stagingSession.load(std::memory_order_acquire);
+    StageHandle& handle = stageHandle;
+    if (handle.session == session) {
+        // nullptr if every slot was taken, the thread then writes directly
+        return handle.stage.get();
+    }
+    handle.release();
+    handle.session = session;
+    handle.token = stageTokens.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    std::scoped_lock<std::mutex> lock(mxStage);
+    // disableStaging() may have ended the session since it was read, a new stage would never be merged
+    if (session == 0 || this->stagingSession.load(std::memory_order_acquire) != session) {
+        return nullptr;
+    }
+    size_t count = this->stageCount.load(std::memory_order_relaxed);
+    // a stage left behind by a thread that exited, possibly with lines the merger hasn't taken yet
+    for (size_t i = 0; i < count; i++) {
+        uint64_t free = 0;
+        if (this->stageStorage[i]->owner.compare_exchange_strong(free, handle.token)) {
+            handle.stage = this->stageStorage[i];
+            return handle.stage.get();
+        }
+    }
+    if (count == logMaxStages) {
+        return nullptr;
+    }
+    handle.stage = std::make_shared<LogStage>(this->stageSize);
+    handle.stage->owner.store(handle.token, std::memory_order_relaxed);
+    this->stageStorage[count] = handle.stage;
+    this->stageCount.store(count + 1, std::memory_order_release);
+    return handle.stage.get();
+}
+
+bool Logger::stageLine(Target target, const char* data, size_t size, Level maxLevel)
+{
+    LogStage* stage = threadStage();
+    if (!stage) {
+        return false;
+    }
+    // pairs with disableStaging(): either it sees the flag and waits for the line, or the session is seen ending
+    stage->writing.store(true, std::memory_order_seq_cst);
+    if (this->stagingSession.load(std::memory_order_seq_cst) != stageHandle.session) {
+        stage->writing.store(false, std::memory_order_release);
+        return false;
+    }
+    LogStageEntry* entry;
+    while (!(entry = stage->reserve(size))) {
+        // full, make sure the merger is awake and give it time to drain
+        cvStageWork.notify_one();
+        std::this_thread::yield();
+    }
+    // the number is taken once the line fits, so the merger never waits on a thread that waits for it
+    uint64_t order = this->stagingOrder == StagingOrder::STRICT
+        ? this->stageSequence.fetch_add(1, std::memory_order_relaxed)
+        : (uint64_t)steady_clock::now().time_since_epoch().count();
+    stage->commit(entry, order, (uint8_t)target, (uint8_t)maxLevel, data, size);
+    stage->writing.store(false, std::memory_order_release);
+    if (this->stageMergerSleeping.load(std::memory_order_acquire)) {
+        cvStageWork.notify_one();
+    }
+    return true;
+}
+
+size_t Logger::mergeStages(uint64_t& nextSequence)
+{
+    size_t count = this->stageCount.load(std::memory_order_acquire);
+    bool strict = this->stagingOrder == StagingOrder::STRICT;
+    Level stdoutLevel = Level::DEB;
+    Level stderrLevel = Level::DEB;
+    bool toStdout = false;
+    bool toStderr = false;
+    size_t merged = 0;
+
+    std::scoped_lock<std::mutex> lock(mxLog);
+    while (merged < stageBatchSize) {
+        // the oldest line at the front of any stage, each stage is in order already
+        LogStage* oldest = nullptr;
+        const LogStageEntry* first = nullptr;
+        for (size_t i = 0; i < count; i++) {
+            const LogStageEntry* entry = this->stageStorage[i]->front();
+            if (entry && (!first || entry->order < first->order)) {
+                first = entry;
+                oldest = this->stageStorage[i].get();
+            }
+        }
+        // in STRICT order a thread took the next number and is still copying its line
+        if (!first || (strict && first->order != nextSequence)) {
+            break;
+        }
+        bool isStderr = first->target == (uint8_t)Target::STDERR;
+        LogFile& stream = isStderr ? this->stderrStream : this->stdoutStream;
+        if (isStderr ? !toStderr : !toStdout) {
+            // whatever the program printed since the last batch is older than these lines
+            if (__fpending(isStderr ? stderr : stdout)) {
+                flushStreamLocked(stream, isStderr ? stderr : stdout);
+            }
+            (isStderr ? toStderr : toStdout) = true;
+        }
+        stream.write(LogStage::payload(*first), first->size);
+        Level& maxLevel = isStderr ? stderrLevel : stdoutLevel;
+        if ((Level)first->level > maxLevel) {
+            maxLevel = (Level)first->level;
+        }
+        oldest->pop();
+        nextSequence++;
+        merged++;
+    }
+    // like async mode, everyLine means once per batch
+    if (toStdout
+        && shouldFlushLocked(this->stdoutStream, stdoutLevel, this->flushPolicy.everyLine && this->stdoutInteractive)) {
+        flushStreamLocked(this->stdoutStream, stdout);
+    }
+    if (toStderr && shouldFlushLocked(this->stderrStream, stderrLevel, this->flushPolicy.everyLine)) {
+        flushStreamLocked(this->stderrStream, stderr);
+    }
+    return merged;
+}
+
+void Logger::stageMergerLoop()
+{
+    uint64_t& nextSequence = this->stageNext;
+    for (;;) {
+        if (mergeStages(nextSequence)) {
+            std::scoped_lock<std::mutex> lock(mxStage);
+            cvStageDone.notify_all();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mxStage);
+        bool empty = true;
+        for (size_t i = 0; i < this->stageCount.load(std::memory_order_acquire) && empty; i++) {
+            empty = this->stageStorage[i]->front() == nullptr;
+        }
+        if (!empty) {
+            // waiting for a line in STRICT order, it is only a copy away
+            lock.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        if (!this->stageMergerRunning) {
+            break;
+        }
+        // the timeout covers a producer that committed right before we announced we were going to sleep
+        this->stageMergerSleeping.store(true, std::memory_order_release);
+        cvStageDone.notify_all();
+        cvStageWork.wait_for(lock, std::chrono::milliseconds(10));
+        this->stageMergerSleeping.store(false, std::memory_order_relaxed);
+    }
+    std::scoped_lock<std::mutex> lock(mxStage);
+    cvStageDone.notify_all();
+}
+#pragma endregion staging
+
+#pragma region memory
+void Logger::enableAllocationAudit()
+{
+    Profiler* profiler = Profiler::getInstance();
+    profiler->AddCounter("logger.allocations", [] { return (long)getLogAllocStats().allocations; });
+    profiler->AddCounter("logger.frees", [] { return (long)getLogAllocStats().frees; });
+    profiler->AddCounter("logger.allocatedBytes", [] { return (long)getLogAllocStats().bytesAllocated; });
+    profiler->AddCounter("logger.liveBytes", [] { return (long)getLogAllocStats().liveBytes; });
+    profiler->AddCounter("logger.peakLiveBytes", [] { return (long)getLogAllocStats().peakLiveBytes; });
+    profiler->AddCounter("logger.truncations", [] { return (long)getLogAllocStats().truncations; });
+    resetLogAllocStats();
+    logAllocAudit.store(true, std::memory_order_relaxed);
+}
+
+void Logger::disableAllocationAudit() { logAllocAudit.store(false, std::memory_order_relaxed); }
+
+void Logger::setFixedCapacity(size_t lineCapacity)
+{
+    logFixedCapacity.store(lineCapacity, std::memory_order_relaxed);
+    if (lineCapacity) {
+        std::scoped_lock<std::mutex> lock(mxLog);
+        this->stdoutStream.allocateBuffer();
+        this->stderrStream.allocateBuffer();
+        this->LoggingFileStream.allocateBuffer();
+    }
+}
+
+void Logger::prepareThread()
+{
+    FormatState& state = formatState;
+    state.info.preallocate();
+    state.line.preallocate();
+    state.message.preallocate();
+    for (LineBuffer& rendered : state.rendered) {
+        rendered.preallocate();
+    }
+    prepareStructuredThread();
+    // the first localtime_r() reads the time zone file
+    LoggerState current = this->getState();
+    appendTimestamp(state.line, this->timestampNow(current.timestampMode), current);
+    state.line.clear();
+    if (this->isStaging()) {
+        threadStage();
+    }
+}
+#pragma endregion memory
+
 char* Logger::getLoggerfunctionInfo(Level level, const std::experimental::source_location location)
 {
-    size_t offset = 0;
-    size_t fullSize = 0;
-    timeString[0] = 0;
-    levelString[0] = 0;
-    fileString[0] = 0;
+    LineBuffer& info = formatState.info;
+    info.clear();
+    LoggerState state = this->getState();
+    appendFunctionInfo(info, state, level, location, this->timestampNow(state.timestampMode));
+    info.reserve(0);
+    return info.data;
+}
+
+int64_t Logger::timestampNow(TimestampMode mode) const
+{
+    if (mode == TimestampMode::ELAPSED) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - this->elapsedEpoch).count();
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+static void appendPadded(LineBuffer& out, uint64_t value, size_t digits)
+{
+    char text[numberFormatMaxChars];
+    out.append(text, formatPadded(text, value, digits));
+}
+
+void Logger::appendTimestamp(LineBuffer& out, int64_t time, const LoggerState& style) const
+{
+    int64_t second = time >= 0 ? time / 1000000000 : (time - 999999999) / 1000000000;
+    uint64_t fraction = (uint64_t)(time - second * 1000000000);
+
+    FormatState& state = formatState;
+    if (state.lastSecond != second || state.lastMode != (short)style.timestampMode) {
+        state.lastSecond = second;
+        state.lastMode = (short)style.timestampMode;
+        char* text = state.timeStr;
+        size_t room = sizeof(state.timeStr);
+        if (style.timestampMode == TimestampMode::ELAPSED) {
+            text[0] = '+';
+            state.timeStrSize = 1 + formatSigned(text + 1, second);
+        } else {
+            std::time_t seconds = (std::time_t)second;
+            struct tm timeStruct;
+            if (style.timestampMode == TimestampMode::UTC_ISO8601) {
+                gmtime_r(&seconds, &timeStruct);
+                state.timeStrSize = strftime(text, room, "%Y-%m-%dT%H:%M:%S", &timeStruct);
+            } else {
+                localtime_r(&seconds, &timeStruct);
+                state.timeStrSize = strftime(text, room, "%d/%b/%Y %H:%M:%S", &timeStruct);
+            }
+        }
+    }
+    out.append(state.timeStr, state.timeStrSize);
+
+    if (style.timestampPrecision == TimestampPrecision::MILLISECONDS) {
+        out.append('.');
+        appendPadded(out, fraction / 1000000, 3);
+    } else if (style.timestampPrecision == TimestampPrecision::MICROSECONDS) {
+        out.append('.');
+        appendPadded(out, fraction / 1000, 6);
+    }
+    if (style.timestampMode == TimestampMode::UTC_ISO8601) {
+        out.append('Z');
+    }
+}
+
+void Logger::appendFunctionInfo(LineBuffer& out, const LoggerState& state, Level level,
+    const std::experimental::source_location location, int64_t time, const char* category) const
+{
     // Append the current date and time if enabled
-    if (this->timestampEnabled) {
-        if (std::time_t time = system_clock::to_time_t(system_clock::now()); this->lastTime < time) {
-            this->lastTime = time;
-            struct tm const* timeStruct = std::localtime(&time);
-            strftime(&this->timeStr[1], 199, "%d/%b/%Y %H:%M:%S", timeStruct);
-        }
-        offset = cpyChar(timeString + offset, this->timeStr);
-        offset += cpyChar(timeString + offset, "] \0");
-        fullSize += offset;
-    }
-
-    if (this->levelEnabled) {
-        offset = cpyChar(levelString, levelMap.at(level));
-        offset += cpyChar(levelString + offset, " \0");
-        fullSize += offset;
-    }
-
-    if (this->fileEnabled) {
-        size_t fileNameSize = strlen(location.file_name());
-        size_t funcNameSize = strlen(location.function_name());
-        size_t stringSize = fileNameSize + funcNameSize + 20 + 5;
-
-        if (stringSize > fileStringSize) {
-            fileStringSize = stringSize + 8;
-            free(fileString);
-            fileString = (char*)malloc(sizeof(char) * (stringSize));
-        }
-        offset = cpyChar(fileString, location.file_name());
-        offset += cpyChar(fileString + offset, ":");
-        offset += cpyChar(fileString + offset, location.line());
-        offset += cpyChar(fileString + offset, ";");
-        offset += cpyChar(fileString + offset, location.column());
-        offset += cpyChar(fileString + offset, "  ");
-        offset += cpyChar(fileString + offset, location.function_name());
-        cpyChar(fileString + offset, "\0");
-        fullSize += offset;
-    }
-    if (fullSize > loggerFunctionInfoStringSize) {
-        loggerFunctionInfoStringSize = fullSize;
-        free(loggerFunctionInfoString);
-        loggerFunctionInfoString = (char*)malloc(sizeof(char) * (fullSize));
-    }
-    offset = cpyChar(loggerFunctionInfoString, timeString);
-    offset += cpyChar(loggerFunctionInfoString + offset, levelString);
-    cpyChar(loggerFunctionInfoString + offset, fileString);
-
-    return loggerFunctionInfoString;
+    if (state.timestamp) {
+        out.append('[');
+        appendTimestamp(out, time, state);
+        out.append("] ", 2);
+    }
+
+    if (state.showLevel) {
+        out.append(levelName(level));
+        out.append(' ');
+    }
+
+    if (category) {
+        out.append(category);
+        out.append(' ');
+    }
+
+    if (state.fileInfo) {
+        // registering a call site allocates, the fixed capacity mode formats the prefix every time instead
+        const LogCallSite* site = !this->cacheCallSites || logFixedCapacity.load(std::memory_order_relaxed)
+            ? nullptr
+            : logCallSite(location);
+        if (site) {
+            out.append(site->prefix, site->prefixLength);
+        } else {
+            appendCallSite(out, location);
+        }
+    }
 }
@@ -1,11 +1,32 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
+#include "BinaryLog.hpp"
+#include "LineBuffer.hpp"
+#include "LogCallSite.hpp"
+#include "LogFile.hpp"
+#include "LogFlightRecorder.hpp"
+#include "LogFormat.hpp"
+#include "LogLevel.hpp"
+#include "LogQueue.hpp"
+#include "LogRotation.hpp"
+#include "LogSink.hpp"
+#include "LogStage.hpp"
+#include "LogStructured.hpp"
+#include "MmapLogFile.hpp"
 #include "Profiler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
 #include <experimental/source_location>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #ifdef DEBUG
 #define DEFAULT_ENABLE_FILE_INFO true;
@@ -24,62 +45,192 @@ size_t cpyChar(char* dest, unsigned int src);
 
 extern std::mutex mxLog;
 
-enum class Target : short { DISABLED = 0,
-    STDOUT = 1,
-    STDERR = 2,
-    LOG_FILE = 4 };
-
-enum class Level : short { DEB = 1,
-    INFO = 2,
-    NOTICE = 3,
-    WARNING = 4,
-    ERR = 5,
-    CRIT = 6,
-    ALERT = 7,
-    EMERG = 8 };
-
-// String representations of Logger levels
-static const map<Level, const char*> levelMap = {
-    { Level::DEB, "DEBUG" },
-    { Level::INFO, "INFO" },
-    { Level::NOTICE, "NOTICE" },
-    { Level::WARNING, "WARNING" },
-    { Level::ERR, "ERROR" },
-    { Level::CRIT, "CRITICAL" },
-    { Level::ALERT, "ALERT" },
-    { Level::EMERG, "EMERGENCY" } //
+// When buffered LOG_FILE, STDOUT and STDERR data is written out. The conditions are combined, any one of them flushes.
+struct LogFlushPolicy {
+    // flush after every write() (every batch in async mode), the historical behaviour
+    bool everyLine = true;
+    // flush once this many bytes are buffered, 0 disables
+    size_t maxBufferedBytes = 0;
+    // flush from a background timer, 0 disables
+    std::chrono::milliseconds interval { 0 };
+    // always flush right away for messages at or above this level
+    Level flushLevel = Level::EMERG;
+    // fsync after every flush for durability
+    bool fsync = false;
+};
+
+// Per call site limits for log storms. Suppressed messages only touch the Logger's atomic counters of the site,
+// the counts are logged by the Logger itself.
+struct LogRateLimit {
+    // messages per second a call site may log, 0 disables the rate limit
+    double perSecond = 0;
+    // messages a quiet call site may log at once before the rate applies
+    unsigned int burst = 10;
+    // swallow a message identical to the previous one from the same call site, "last message repeated N times"
+    bool collapseRepeats = false;
+    // how often suppression counts are logged, 0 logs them when the call site gets through again
+    std::chrono::milliseconds reportInterval { 10000 };
+    // messages at or above this level are never limited
+    Level unlimitedLevel = Level::EMERG;
+
+    bool enabled() const { return perSecond > 0 || collapseRepeats; }
+};
+
+// What an async Logger does when its queue is full.
+enum class OverflowPolicy : short { BLOCK = 0, // wait for the writer thread to make room
+    DROP_NEWEST = 1, // discard the record that did not fit
+    DROP_OLDEST = 2 }; // evict the oldest queued record to make room
+
+// How a staging Logger orders STDOUT/STDERR lines from different threads, see Logger::enableStaging().
+enum class StagingOrder : short { PER_THREAD = 0, // each thread's lines stay in order, threads interleave by timestamp
+    STRICT = 1 }; // one order across all threads, costs a shared atomic counter per line
+
+// A log call captured on the caller thread, formatted later by the async writer.
+// Either message holds the finished text or format/args hold a deferred "{}" call.
+struct LogRecord {
+    Level level = Level::INFO;
+    int64_t time = 0; // ns, see Logger::timestampNow()
+    std::experimental::source_location location;
+    string message;
+    const char* format = nullptr;
+    LogArgs args;
+    const char* category = nullptr;
+    LoggerState state;
+};
+
+// Format string of the variadic log calls, picks up the call site the same way the logXxx defaults do.
+// The string is kept by pointer until the record is written so it has to be a literal (or outlive the Logger).
+struct LogFormatString {
+    const char* format;
+    std::experimental::source_location location;
+
+    LogFormatString(
+        const char* format, const std::experimental::source_location location = std::experimental::source_location::current())
+        : format(format)
+        , location(location)
+    {
+    }
+};
+
+class Logger;
+
+// A named part of the program ("net", "db") with a level of its own, see Logger::category().
+// Records go to the same targets and sinks as the Logger's own, only the level check differs.
+class LogCategory {
+public:
+    LogCategory(Logger& owner, const string& name, Level level);
+    LogCategory(const LogCategory&) = delete;
+    LogCategory& operator=(const LogCategory&) = delete;
+
+    const string& getName() const { return this->name; }
+
+    /* Cheap check (one relaxed load) whether a message at this level would be logged or captured.
+     *
+     * \param	Level	The level to check
+     * \return	bool	true if the message would be logged
+     */
+    bool isEnabled(Level level) const { return level >= this->threshold.load(std::memory_order_relaxed); }
+
+    /* Change the level, safe while other threads are logging through the category.
+     *
+     * \param	Level	Minimum severity of messages to log
+     */
+    void setLevel(Level level);
+    Level getLevel() const { return (Level)((this->levels.load(std::memory_order_relaxed) >> 16) & 0xff); }
+
+    /* The level a record logged under the Logger's settings of this generation is checked against.
+     * Logger::setState() changes category levels together with the Logger's, a record sees both old or both new.
+     *
+     * \param	uint16_t	LoggerState::generation
+     * \return	Level	The level
+     */
+    Level levelAt(uint16_t generation) const
+    {
+        uint64_t word = this->levels.load(std::memory_order_acquire);
+        return (Level)((int16_t)(generation - (uint16_t)word) >= 0 ? (word >> 16) & 0xff : (word >> 24) & 0xff);
+    }
+
+    void write(Level level, const char* message,
+        const std::experimental::source_location location = std::experimental::source_location::current());
+
+    template <typename... Args>
+    void logFormat(Level level, const std::experimental::source_location& location, const char* format, const Args&... args);
+
+    template <typename... Args>
+    void debug(LogFormatString format, const Args&... args) { this->logFormat(Level::DEB, format.location, format.format, args...); }
+    template <typename... Args>
+    void info(LogFormatString format, const Args&... args) { this->logFormat(Level::INFO, format.location, format.format, args...); }
+    template <typename... Args>
+    void notice(LogFormatString format, const Args&... args) { this->logFormat(Level::NOTICE, format.location, format.format, args...); }
+    template <typename... Args>
+    void warning(LogFormatString format, const Args&... args) { this->logFormat(Level::WARNING, format.location, format.format, args...); }
+    template <typename... Args>
+    void error(LogFormatString format, const Args&... args) { this->logFormat(Level::ERR, format.location, format.format, args...); }
+    template <typename... Args>
+    void critical(LogFormatString format, const Args&... args) { this->logFormat(Level::CRIT, format.location, format.format, args...); }
+    template <typename... Args>
+    void alert(LogFormatString format, const Args&... args) { this->logFormat(Level::ALERT, format.location, format.format, args...); }
+    template <typename... Args>
+    void emergency(LogFormatString format, const Args&... args) { this->logFormat(Level::EMERG, format.location, format.format, args...); }
+
+private:
+    friend class Logger;
+    Logger& owner;
+    const string name;
+    // generation the level applies from (bits 0-15), level (16-23) and the level before it (24-31)
+    std::atomic<uint64_t> levels;
+    // the lower of the levels in use and the flight recorder's capture level, what isEnabled() compares against
+    std::atomic<Level> threshold;
+    void stageLevel(Level level, uint16_t generation);
+    void updateThreshold();
 };
 
 // TODO fix file being created even if im not logging to file
 class Logger {
 private:
     std::mutex mxLog;
+    // LoggerState::pack() of the current settings, see getState()
+    std::atomic<uint64_t> state;
+    // serializes changes of the state
+    std::mutex mxState;
+
+    template <typename Change>
+    void updateState(Change&& change)
+    {
+        std::scoped_lock<std::mutex> lock(mxState);
+        LoggerState next = LoggerState::unpack(this->state.load(std::memory_order_relaxed));
+        change(next);
+        next.generation++;
+        this->state.store(next.pack(), std::memory_order_release);
+    }
 
 public:
-    // write() uses these variables to determine which messages should be written where.
-    Level LoggerLevel = DEFAULT_LOG_LEVEL;
-    short LoggerTarget = 0;
     string LoggerFile = "log.log";
-    ofstream LoggingFileStream;
-
-    // this can speed up time stamp aquisition by 75%
-    std::time_t lastTime = 0;
-    char timeStr[200] = "[";
+    LogFile LoggingFileStream;
+    BinaryLogWriter binaryLog;
+    string LoggerMmapFile;
+    MmapLogFile mmapFile;
 
-    // Flags that change Logger style
-    bool timestampEnabled = true;
-    bool levelEnabled = true;
-    bool fileEnabled = DEFAULT_ENABLE_FILE_INFO;
+    // Level, targets and style flags are in the LoggerState, see getState()
     bool deletePrevLog = true;
+    // Look call sites up in the process-wide table, which keys them by their file and function pointers. Turn off
+    // when locations are built from run time strings (utilis-logdecode), the file info is then formatted every time
+    // and the rate limit doesn't apply.
+    bool cacheCallSites = true;
 
+    Logger();
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
     ~Logger()
     {
+        this->removeCrashHandler();
+        this->disableAsync();
+        this->disableStaging();
+        this->stopRateReporter();
+        this->stopFlushTimer();
         this->LoggingFileStream.close();
-        free(timeString);
-        free(levelString);
-        free(fileString);
-        free(loggerFunctionInfoString);
-        free(loggerMessageString);
+        this->flushStreamLocked(this->stdoutStream, stdout);
+        this->flushStreamLocked(this->stderrStream, stderr);
     }
 
 #pragma region Target and level
@@ -92,6 +243,7 @@ public:
 
     void xorTarget(Target target);
     void orTarget(Target target);
+    Target getTarget() const { return (Target)this->getState().targets; }
     /* Set the severity of messages to Logger.
      *
      * \param	Level	The Logger level to set
@@ -105,6 +257,34 @@ public:
      */
     Level getLevel() const;
 
+    /* Level, targets and style flags as one consistent snapshot, lock free.
+     *
+     * \return	LoggerState	The settings in effect
+     */
+    LoggerState getState() const { return LoggerState::unpack(this->state.load(std::memory_order_acquire)); }
+
+    /* Replace level, targets and style flags at once, together with the levels of some categories.
+     * Every log call reads the settings once: a record is written either entirely with the old ones
+     * or entirely with the new ones, categories included.
+     *
+     * \param	LoggerState	The new settings, the generation is ignored
+     * \param	vector	Category names and their new levels, categories are created as needed
+     */
+    void setState(LoggerState next, const std::vector<std::pair<string, Level>>& categoryLevels = {});
+
+    /* Cheap check whether a message of this level would be written anywhere.
+     * Used by the UTILIS_LOG_* macros before any argument is evaluated.
+     *
+     * \param	Level	The level to check
+     * \return	bool	true if the message would be logged
+     */
+    bool isEnabled(Level level) const
+    {
+        LoggerState state = LoggerState::unpack(this->state.load(std::memory_order_relaxed));
+        return level >= std::min(state.level, this->flightRecorderLevel.load(std::memory_order_relaxed))
+            && (state.targets != (short)Target::DISABLED || this->extraSinks.load(std::memory_order_relaxed) > 0);
+    }
+
     /* Convert the Level enum to a string.
      *
      * \param	Level	The level to convert
@@ -114,6 +294,40 @@ public:
 
 #pragma endregion Target and level
 
+#pragma region categories
+    /* The category with this name, created with the current Logger level the first time it is asked for.
+     * Keep the reference, it stays valid as long as the Logger.
+     *
+     * \param	string	Name of the category
+     * \return	LogCategory	The category
+     */
+    LogCategory& category(const string& name);
+#pragma endregion categories
+
+#pragma region sinks
+    /* Send every record to an additional output. Each record is rendered once per distinct formatter,
+     * sinks sharing a formatter get the same buffer. Safe to call while other threads are logging.
+     *
+     * \param	LogSink	The sink, kept alive by the Logger until it is removed
+     */
+    void addSink(std::shared_ptr<LogSink> sink);
+
+    /* Stop sending records to a sink added with addSink().
+     *
+     * \param	LogSink	The sink to remove
+     * \return	bool	false if it wasn't added
+     */
+    bool removeSink(const std::shared_ptr<LogSink>& sink);
+
+    /* The sink behind one of the built-in targets, to give it its own level or formatter.
+     * The target bit still switches it on and off.
+     *
+     * \param	Target	A single target
+     * \return	LogSink	The sink, nullptr for DISABLED or a combination of targets
+     */
+    std::shared_ptr<LogSink> getTargetSink(Target target) const;
+#pragma endregion sinks
+
 #pragma region setFile
     /* Set a file to Logger to if the target is LOG_FILE.
      *
@@ -124,6 +338,54 @@ public:
 
     short setFile(const string& fileName, ofstream::openmode mode, bool deleteFile = false,
         const std::experimental::source_location location = std::experimental::source_location::current());
+
+    /* Append to another file unless it is the open one already. Leaves the targets alone and logs nothing,
+     * for callers that report errors themselves (LoggerConfig).
+     *
+     * \param	string	The file to which we will Logger
+     * \return	bool	false if it can't be opened, the previous file stays in use then
+     */
+    bool switchFileIfChanged(const string& fileName);
+
+    /* Open a binary log file and add LOG_BINARY to the targets.
+     * Records are written unformatted, use utilis-logdecode to turn the file into text.
+     *
+     * \param	string	The file to which we will Logger
+     */
+    short setBinaryFile(const string& fileName, bool deleteFile = false,
+        const std::experimental::source_location location = std::experimental::source_location::current());
+
+    /* Open a memory mapped log file and add LOG_MMAP to the targets.
+     * Lines are copied into the mapping without taking the Logger lock, the file is
+     * extended chunkSize bytes at a time and truncated to its real length when closed or rotated.
+     *
+     * \param	string	The file to which we will Logger
+     * \param	size_t	How much the file is extended/mapped at a time
+     */
+    short setMmapFile(const string& fileName, bool deleteFile = false, size_t chunkSize = mmapDefaultChunkSize,
+        const std::experimental::source_location location = std::experimental::source_location::current());
+
+    /* Number of LOG_MMAP lines dropped because the file could not be extended or mapped.
+     * The first drop is reported on STDERR, rotation or setMmapFile() start over.
+     *
+     * \return	uint64_t	Dropped line count since the mmap file was opened
+     */
+    uint64_t getMmapDroppedCount() const { return this->mmapFile.getDropped(); }
+
+    /* Write LOG_FILE through io_uring: each flush submits the buffer and swaps in a free one, up to depth
+     * writes are in flight. Falls back to pwrite(2) where io_uring is unavailable. Kept across setFile()
+     * and rotation. The file must not be appended to by other writers meanwhile.
+     *
+     * \param	unsigned	Writes in flight, 0 goes back to plain write(2)
+     * \return	bool	true if the kernel ring is used
+     */
+    bool setFileUring(unsigned int depth = logUringDefaultDepth);
+
+    /* Counters and submission/completion latency histograms of the LOG_FILE io_uring.
+     *
+     * \return	LogUringStats	Copy of the counters, all zero if setFileUring() is off
+     */
+    LogUringStats getUringStats();
 #pragma endregion setFile
 
     /* Log a message.
@@ -132,9 +394,277 @@ public:
      * \param	string	The message to write
      */
     void write(Level level, const char* message, const std::experimental::source_location location);
+    void inline write(Level level, std::string const& message, const std::experimental::source_location location)
+    {
+        this->write(level, message.c_str(), location);
+    }
 
+    /* Build the "[time] LEVEL file:line;column  function" prefix for a log line.
+     * The returned buffer belongs to the calling thread and is reused by its next call.
+     */
     char* getLoggerfunctionInfo(Level level, const std::experimental::source_location location);
 
+    /* Append a complete text line ("prefix:\nmessage\n") as write() would produce it.
+     *
+     * \param	LineBuffer	Output, appended to
+     * \param	Level	The severity of the message
+     * \param	char*	The message
+     * \param	location	Call site
+     * \param	int64_t	Timestamp to print, see timestampNow()
+     * \param	char*	Category name printed after the level, nullptr for none
+     * \param	LoggerState	Style flags to use, nullptr for the current ones
+     */
+    void appendLine(LineBuffer& out, Level level, const char* message, const std::experimental::source_location location,
+        int64_t time, const char* category = nullptr, const LoggerState* state = nullptr) const;
+
+#pragma region Format logs
+    /* Log a "{}" format string. Arguments are copied into the record and only formatted
+     * if it is written (on the writer thread in async mode).
+     *
+     * \param	Level	The severity of the message
+     * \param	location	Call site
+     * \param	char*	Format string literal, "{}" is replaced by the next argument
+     * \param	Args	Values for the placeholders
+     */
+    template <typename... Args>
+    void logFormat(Level level, const std::experimental::source_location& location, const char* format, const Args&... args)
+    {
+        if (!this->isEnabled(level)) {
+            return;
+        }
+        LogArgs packed;
+        (packed.add(args), ...);
+        this->writeFormat(level, format, packed, location);
+    }
+
+    /* Log an already packed format call, see logFormat().
+     */
+    void writeFormat(Level level, const char* format, LogArgs& args, const std::experimental::source_location location);
+
+    template <typename... Args>
+    void debug(LogFormatString format, const Args&... args) { this->logFormat(Level::DEB, format.location, format.format, args...); }
+    template <typename... Args>
+    void info(LogFormatString format, const Args&... args) { this->logFormat(Level::INFO, format.location, format.format, args...); }
+    template <typename... Args>
+    void notice(LogFormatString format, const Args&... args) { this->logFormat(Level::NOTICE, format.location, format.format, args...); }
+    template <typename... Args>
+    void warning(LogFormatString format, const Args&... args) { this->logFormat(Level::WARNING, format.location, format.format, args...); }
+    template <typename... Args>
+    void error(LogFormatString format, const Args&... args) { this->logFormat(Level::ERR, format.location, format.format, args...); }
+    template <typename... Args>
+    void critical(LogFormatString format, const Args&... args) { this->logFormat(Level::CRIT, format.location, format.format, args...); }
+    template <typename... Args>
+    void alert(LogFormatString format, const Args&... args) { this->logFormat(Level::ALERT, format.location, format.format, args...); }
+    template <typename... Args>
+    void emergency(LogFormatString format, const Args&... args) { this->logFormat(Level::EMERG, format.location, format.format, args...); }
+#pragma endregion Format logs
+
+#pragma region flush policy
+    /* Decide when buffered LOG_FILE, STDOUT and STDERR data is written (LOG_FILE optionally fsync'ed).
+     *
+     * \param	LogFlushPolicy	The policy to use
+     */
+    void setFlushPolicy(const LogFlushPolicy& policy);
+
+    /* Syscall counters of the LOG_FILE target, see LogFileStats::bytesPerFlush().
+     *
+     * \return	LogFileStats	Copy of the counters
+     */
+    LogFileStats getFileStats();
+
+    /* Syscall counters of the STDOUT or STDERR target.
+     *
+     * \param	Target	Target::STDOUT or Target::STDERR
+     * \return	LogFileStats	Copy of the counters
+     */
+    LogFileStats getStreamStats(Target target);
+#pragma endregion flush policy
+
+#pragma region rate limit
+    /* Limit how often each call site can log, see LogRateLimit. Should be called before other threads start logging.
+     *
+     * \param	LogRateLimit	The limits, a default constructed one turns limiting off
+     */
+    void setRateLimit(const LogRateLimit& limit);
+
+    /* Messages dropped by the rate limit or collapsed as repeats since setRateLimit().
+     */
+    uint64_t getSuppressedCount() const { return this->rateSuppressed.load(std::memory_order_relaxed); }
+
+    /* Log the pending suppression counts of this Logger now instead of waiting for the report interval.
+     * The reports are WARNING messages and go through the same level checks as the message they refer to.
+     */
+    void reportSuppressed();
+#pragma endregion rate limit
+
+#pragma region rotation
+    /* Rotate the LOG_FILE target once it reaches a size or age limit, LOG_MMAP uses the size limit.
+     * The current file is renamed and reopened while holding the write lock, so no line is split between files;
+     * renumbering to <file>.1 ... <file>.N and gzip compression happen on a background thread.
+     *
+     * \param	LogRotation	Limits, number of files to keep and whether to compress them
+     */
+    void setRotation(const LogRotation& rotation);
+
+    /* Rotate the LOG_FILE target now, regardless of the limits.
+     */
+    void rotateFile();
+
+    /* Block until rotated files have been renumbered and compressed.
+     */
+    void waitForRotation() { this->rotator.waitIdle(); }
+#pragma endregion rotation
+
+#pragma region timestamp
+    /* Print milli or microseconds after the seconds of each timestamp.
+     *
+     * \param	TimestampPrecision	Precision to use
+     */
+    void setTimestampPrecision(TimestampPrecision precision)
+    {
+        updateState([precision](LoggerState& next) { next.timestampPrecision = precision; });
+    }
+
+    /* Switch between local time, UTC ISO-8601 and monotonic time elapsed since the Logger was created.
+     *
+     * \param	TimestampMode	Mode to use
+     */
+    void setTimestampMode(TimestampMode mode)
+    {
+        updateState([mode](LoggerState& next) { next.timestampMode = mode; });
+    }
+
+    /* Current time in the clock of a timestamp mode.
+     *
+     * \param	TimestampMode	Mode of the record the time is for, the current one by default
+     * \return	int64_t	Nanoseconds since the epoch, or since the Logger was created for ELAPSED
+     */
+    int64_t timestampNow() const { return timestampNow(this->getState().timestampMode); }
+    int64_t timestampNow(TimestampMode mode) const;
+
+    /* Append a timestamp, without the brackets of the text line.
+     *
+     * \param	LineBuffer	Output, appended to
+     * \param	int64_t	Timestamp, see timestampNow()
+     * \param	LoggerState	Snapshot the time was taken with, gives the mode and precision
+     */
+    void appendTimestamp(LineBuffer& out, int64_t time, const LoggerState& state) const;
+#pragma endregion timestamp
+
+#pragma region async
+    /* Hand formatting and target writes over to a background writer thread.
+     * Callers only capture the record and push it into a bounded queue.
+     * Should be called before other threads start logging.
+     *
+     * \param	size_t	Queue capacity in records (rounded up to a power of two)
+     * \param	OverflowPolicy	What to do with a record when the queue is full
+     */
+    void enableAsync(size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::BLOCK);
+
+    /* Drain everything still queued, stop the writer thread and go back to writing on the caller thread.
+     */
+    void disableAsync();
+
+    /* Block until every record logged before this call has been written to its targets.
+     */
+    void flush();
+
+    bool isAsync() const { return this->asyncQueue != nullptr; }
+
+    /* Number of records discarded by the DROP_NEWEST/DROP_OLDEST overflow policies.
+     *
+     * \return	uint64_t	Dropped record count since enableAsync()
+     */
+    uint64_t getDroppedCount() const { return this->asyncDropped.load(std::memory_order_relaxed); }
+#pragma endregion async
+
+#pragma region staging
+    /* Stop STDOUT/STDERR lines from serializing on the Logger lock: each thread appends its lines to a staging
+     * buffer of its own and a merger thread writes them out in order, many lines per lock and write(2).
+     * Lines reach the terminal a little later, flush() waits for them; as in async mode the program's own stdio
+     * output can overtake lines that are still staged. Should be called before other threads start logging.
+     * Beyond logMaxStages threads at once lines are written directly and may jump the queue.
+     *
+     * \param	StagingOrder	PER_THREAD or STRICT ordering between threads
+     * \param	size_t	Staging buffer size per thread
+     */
+    void enableStaging(StagingOrder order = StagingOrder::PER_THREAD, size_t bufferSize = logStageDefaultSize);
+
+    /* Write out everything staged, stop the merger and go back to writing on the caller thread.
+     */
+    void disableStaging();
+
+    bool isStaging() const { return this->stagingSession.load(std::memory_order_relaxed) != 0; }
+#pragma endregion staging
+
+#pragma region memory
+    /* Count the heap allocations of the Logger's internals (see LogAlloc.hpp) and report them as Profiler counters
+     * logger.allocations, logger.frees, logger.allocatedBytes, logger.liveBytes, logger.peakLiveBytes and
+     * logger.truncations. Costs a few relaxed atomic adds per allocation, nothing while it is off.
+     * Not counted: strings callers build for the std::string overloads, records queued in async mode, rotation,
+     * LOG_BINARY's call site table and the Logger's own setup (sinks, categories, file names).
+     */
+    void enableAllocationAudit();
+    void disableAllocationAudit();
+    LogAllocStats getAllocationStats() const { return getLogAllocStats(); }
+
+    /* Fixed capacity mode for latency sensitive threads: line and message buffers are grown once to lineCapacity
+     * bytes and never beyond, whatever doesn't fit is cut off and counted as a truncation. The arguments of the
+     * format calls stay within their inline logArgsInlineSize bytes.
+     * The stream and file buffers are allocated here and by setFile(), which also calls prepareThread().
+     * Every other logging thread calls prepareThread() before its first log call; after that writing to STDOUT,
+     * STDERR, LOG_FILE and LOG_MMAP doesn't touch the heap on the calling thread. Process wide, 0 turns it off.
+     * Call setFlushPolicy() before, a bigger buffer is allocated lazily. Rate limiting still registers each call
+     * site on its first use.
+     *
+     * \param	size_t	Bytes per buffer
+     */
+    void setFixedCapacity(size_t lineCapacity);
+
+    /* Allocate the calling thread's scratch buffers (and its staging buffer) and load the time zone now instead of
+     * at its first log call.
+     */
+    void prepareThread();
+#pragma endregion memory
+
+#pragma region flight recorder
+    /* Keep records below the Logger level in a fixed size in-memory ring, without formatting them, and write the
+     * most recent ones to the targets when a record at or above the trigger level is logged.
+     * Should be called before other threads start logging.
+     *
+     * \param	size_t	Memory budget in bytes, allocated here once
+     * \param	Level	Records at or above this level write out the ring first
+     * \param	size_t	Maximum number of records written per trigger
+     * \param	Level	Lowest level captured
+     */
+    void enableFlightRecorder(size_t memoryBudget = 1 << 20, Level triggerLevel = Level::ERR, size_t dumpCount = 256,
+        Level captureLevel = Level::DEB);
+
+    /* Stop capturing, the ring is kept until the Logger is destroyed or the recorder is enabled again.
+     */
+    void disableFlightRecorder();
+
+    /* Write the captured records that haven't been written by an earlier trigger.
+     */
+    void dumpFlightRecorder();
+#pragma endregion flight recorder
+
+#pragma region crash handler
+    /* On SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT write out what is still buffered for STDOUT, STDERR and
+     * LOG_FILE, the staged lines, the flight recorder, the records waiting in the async queue and a final EMERG
+     * record naming the signal, then re-raise the signal with the handler that was installed before.
+     * The handler only uses write(2)/pwrite(2) and memory reserved here, so its lines have a fixed format:
+     * UTC timestamp (or elapsed time), level, file:line, message. Extra sinks, LOG_BINARY and records the async
+     * writer thread already took off the queue are not drained. Only one Logger can own the handler, the calling
+     * thread also gets an alternate signal stack so stack overflows are caught. Nothing is added to the write path.
+     */
+    void installCrashHandler();
+
+    /* Put back the signal handlers that were installed before installCrashHandler().
+     */
+    void removeCrashHandler();
+#pragma endregion crash handler
+
 #pragma region Logs
     /* Log a Debug(lvl 1) message.
      *
@@ -256,46 +786,219 @@ public:
 
     /* Date and time will no longer be printed with each Logger message.
      */
-    void excludeTimestamp() { this->timestampEnabled = false; }
+    void excludeTimestamp()
+    {
+        this->updateState([](LoggerState& state) { state.timestamp = false; });
+    }
 
     /* Date and time will be printed with each Logger message.
      */
-    void includeTimestamp() { this->timestampEnabled = true; }
+    void includeTimestamp()
+    {
+        this->updateState([](LoggerState& state) { state.timestamp = true; });
+    }
 
     /* Logger level will no longer be printed with each Logger message.
      */
-    void excludeLoggerLevel() { this->levelEnabled = false; }
+    void excludeLoggerLevel()
+    {
+        this->updateState([](LoggerState& state) { state.showLevel = false; });
+    }
 
     /* Logger level will be printed with each Logger message.
      */
-    void includeLoggerLevel() { this->levelEnabled = true; }
+    void includeLoggerLevel()
+    {
+        this->updateState([](LoggerState& state) { state.showLevel = true; });
+    }
 
     /* Function info will no longer be printed with each Logger message.
      */
-    void excludeFunctionInfo() { this->fileEnabled = false; }
+    void excludeFunctionInfo()
+    {
+        this->updateState([](LoggerState& state) { state.fileInfo = false; });
+    }
 
     /* Function info will be printed with each Logger message.
      */
-    void includeFunctionInfo() { this->fileEnabled = true; }
+    void includeFunctionInfo()
+    {
+        this->updateState([](LoggerState& state) { state.fileInfo = true; });
+    }
 
 #pragma endregion boolSets
 
 protected:
-#define tempStringStartSize 256
-    size_t fileStringSize = tempStringStartSize;
-    size_t loggerFunctionInfoStringSize = tempStringStartSize;
-    size_t loggerMessageSize = tempStringStartSize * 2;
+    // Line assembly happens in per-thread buffers (see Logger.cpp), only writeTarget() is synchronized.
+    void appendFunctionInfo(LineBuffer& out, const LoggerState& state, Level level,
+        const std::experimental::source_location location, int64_t time, const char* category = nullptr) const;
+    const LineBuffer& formatLine(
+        Level level, const char* message, const std::experimental::source_location location, int64_t time) const;
+    void writeTarget(Target target, const char* data, size_t size, Level maxLevel);
+    void writeBinary(const LoggerState& state, Level level, int64_t time,
+        const std::experimental::source_location& location, const char* message, const char* format, const LogArgs* args);
+
+private:
+    // The built-in targets, registered as the first sinks of every list.
+    class TargetSink;
+    std::shared_ptr<LogSink> targetSinks[5];
+
+    // Logging threads read the current list without locking. Replaced lists stay alive until the Logger is
+    // destroyed because a thread may still be iterating them; sinks are rarely added so this stays small.
+    struct SinkList {
+        std::vector<std::shared_ptr<LogSink>> sinks;
+    };
+    std::atomic<const SinkList*> sinkList { nullptr };
+    std::vector<std::unique_ptr<SinkList>> sinkLists;
+    std::atomic<int> extraSinks { 0 };
+    std::mutex mxSinks;
+    void publishSinks(std::unique_ptr<SinkList> list);
+    void dispatch(LogEntry& entry);
+
+    friend class LogCategory;
+    std::mutex mxCategories;
+    std::vector<std::unique_ptr<LogCategory>> categories;
+    void updateCategoryThresholds();
+
+    // Everything after the level check of write()/writeFormat() and the categories.
+    void writeRecord(const LogCategory* category, Level level, const char* message, const char* format, LogArgs* args,
+        const std::experimental::source_location& location);
+    // writeRecord() after the level and rate checks
+    void deliver(const LoggerState& state, const char* category, Level level, const char* message, const char* format,
+        LogArgs* args, const std::experimental::source_location& location);
+
+    // Rate limiter state of one call site, kept per Logger so Loggers sharing a call site don't
+    // suppress or report each other's messages. Updated without locks from any thread.
+    struct RateSite {
+        // theoretical arrival time of the next message in ns, token bucket as a single value
+        std::atomic<int64_t> tat { 0 };
+        std::atomic<uint64_t> suppressed { 0 };
+        // hash of the last message and how often it was repeated since
+        std::atomic<uint64_t> lastHash { 0 };
+        std::atomic<uint64_t> repeats { 0 };
+        // category of the last limited message, its level also applies to the reports
+        std::atomic<const LogCategory*> category { nullptr };
+    };
+
+    LogRateLimit rateLimit;
+    std::atomic<bool> rateLimited { false };
+    // indexed by LogCallSite::slot, allocated by the first setRateLimit() that enables limiting
+    std::unique_ptr<RateSite[]> rateSites;
+    int64_t rateIntervalNs = 0;
+    int64_t rateToleranceNs = 0;
+    std::atomic<uint64_t> rateSuppressed { 0 };
+    std::thread rateReporter;
+    bool rateReporterRunning = false;
+    std::mutex mxRateReporter;
+    std::condition_variable cvRateReporter;
+    bool admit(const LogCallSite& site, const char* message, const char* format, const LogArgs* args,
+        const LogCategory* category);
+    void reportSite(const LogCallSite& site, RateSite& rate);
+    void stopRateReporter();
+    void rateReporterLoop();
+
+    // EMERG while disabled, nothing is below the Logger level and at or above EMERG
+    std::atomic<Level> flightRecorderLevel { Level::EMERG };
+    Level flightTriggerLevel = Level::ERR;
+    size_t flightDumpCount = 0;
+    std::unique_ptr<LogFlightRecorder> flightRecorder;
+
+    std::chrono::steady_clock::time_point elapsedEpoch = std::chrono::steady_clock::now();
 
-    char* timeString = (char*)malloc(sizeof(char) * tempStringStartSize);
-    char* levelString = (char*)malloc(sizeof(char) * 64);
-    char* fileString = (char*)malloc(sizeof(char) * tempStringStartSize);
+    // LOG_FILE rotation, guarded by mxLog
+    LogRotation rotation;
+    LogRotator rotator;
+    size_t fileBytes = 0;
+    std::chrono::steady_clock::time_point fileOpenedAt;
+    unsigned int rotationCount = 0;
+    void resetFileStats();
+    short reopenFile(const string& fileName, ofstream::openmode mode, bool deleteFile,
+        const std::experimental::source_location& location);
+    void rotateLocked();
+    void rotateMmapLocked();
 
-    char* loggerFunctionInfoString = (char*)malloc(sizeof(char) * tempStringStartSize);
-    char* loggerMessageString = (char*)malloc(sizeof(char) * tempStringStartSize * 2);
+    // STDOUT and STDERR go straight to fds 1 and 2. Pending stdio output is written out before a line is buffered
+    // so lines stay in order with the program's own printf output. Guarded by mxLog.
+    LogFile stdoutStream;
+    LogFile stderrStream;
+    // like stdio, everyLine only applies to stdout when it is a terminal
+    bool stdoutInteractive = false;
+    void writeStreamLocked(LogFile& stream, FILE* stdioStream, const char* data, size_t size, Level maxLevel);
+    void flushStreamLocked(LogFile& stream, FILE* stdioStream);
+    bool shouldFlushLocked(const LogFile& stream, Level maxLevel, bool everyLine) const;
+
+    // reserved by installCrashHandler(), the signal handler formats into it without allocating
+    LineBuffer crashLine;
+    static void crashHandler(int signal);
+    void drainForCrash(int signal);
+    void appendCrashRecord(Level level, int64_t time, const std::experimental::source_location* location,
+        const char* category, const char* message, const char* format, const uint8_t* args, size_t argsSize);
+    void writeCrashLine();
+
+    LogFlushPolicy flushPolicy;
+    std::thread flushTimer;
+    bool flushTimerRunning = false;
+    std::mutex mxFlushTimer;
+    std::condition_variable cvFlushTimer;
+    void flushFileLocked();
+    void stopFlushTimer();
+    void flushTimerLoop();
+
+#define logMaxStages 256
+#define stageBatchSize 4096
+    // Staging for STDOUT/STDERR, see enableStaging(). Stages are handed to threads and recycled when they exit,
+    // the slots only ever grow so the merger and the crash handler can walk them without a lock.
+    std::atomic<uint64_t> stagingSession { 0 };
+    StagingOrder stagingOrder = StagingOrder::PER_THREAD;
+    size_t stageSize = logStageDefaultSize;
+    std::shared_ptr<LogStage> stageStorage[logMaxStages];
+    std::atomic<size_t> stageCount { 0 };
+    std::atomic<uint64_t> stageSequence { 0 };
+    // next STRICT number to merge, owned by the merger and by disableStaging() once it joined it
+    uint64_t stageNext = 0;
+    std::thread stageMerger;
+    bool stageMergerRunning = false;
+    std::atomic<bool> stageMergerSleeping { false };
+    std::mutex mxStage;
+    std::condition_variable cvStageWork;
+    std::condition_variable cvStageDone;
+    LogStage* threadStage();
+    bool stageLine(Target target, const char* data, size_t size, Level maxLevel);
+    size_t mergeStages(uint64_t& nextSequence);
+    void stageMergerLoop();
+
+#define asyncBatchSize 256
+    std::unique_ptr<LogQueue<LogRecord>> asyncQueue;
+    OverflowPolicy asyncPolicy = OverflowPolicy::BLOCK;
+    std::thread asyncWriter;
+    std::atomic<bool> asyncRunning { false };
+    std::atomic<bool> asyncWriterSleeping { false };
+    // queue position below which every record is written or evicted, flush() waits for it to pass LogQueue::pushed()
+    std::atomic<uint64_t> asyncWritten { 0 };
+    std::atomic<uint64_t> asyncDropped { 0 };
+    std::mutex mxAsync;
+    std::condition_variable cvAsyncWork;
+    std::condition_variable cvAsyncDone;
+
+    bool prepareWrite(const LoggerState& state);
+    void enqueue(LogRecord& record);
+    void asyncWriterLoop();
 };
 
 extern Logger logger;
 
+template <typename... Args>
+void LogCategory::logFormat(
+    Level level, const std::experimental::source_location& location, const char* format, const Args&... args)
+{
+    if (!this->isEnabled(level)) {
+        return;
+    }
+    LogArgs packed;
+    (packed.add(args), ...);
+    this->owner.writeRecord(this, level, nullptr, format, &packed, location);
+}
+
 #pragma region Bit - wise operators
 inline Target operator&(Target a, Target b)
 {
@@ -306,6 +1009,81 @@ inline Target operator|(Target a, Target b)
     return static_cast<Target>(static_cast<short>(a) | static_cast<short>(b));
 }
 #pragma endregion Bit - wise operators
+
+#pragma region Log macros
+// Compile time floor for the UTILIS_LOG_* macros, calls below it are compiled out entirely.
+// Defaults to the same level as DEFAULT_LOG_LEVEL, define UTILIS_LOG_MIN_LEVEL (1-8, 9 disables all) to override.
+#ifndef UTILIS_LOG_MIN_LEVEL
+#ifdef DEBUG
+#define UTILIS_LOG_MIN_LEVEL 1
+#else
+#define UTILIS_LOG_MIN_LEVEL 2
+#endif
+#endif
+
+#define UTILIS_LOG_COMPILED(level) ((short)(level) >= UTILIS_LOG_MIN_LEVEL)
+
+// The message expression is only evaluated when the level survives both the compile time floor and the
+// runtime level/target check. Disabled levels still get type checked but generate no code.
+#define UTILIS_LOG_AT(level, ...)                                                                                   \
+    do {                                                                                                            \
+        if (UTILIS_LOG_COMPILED(level) && logger.isEnabled(level)) {                                                \
+            logger.write(level, __VA_ARGS__, std::experimental::source_location::current());                        \
+        }                                                                                                           \
+    } while (0)
+
+#define UTILIS_LOG_DEBUG(...) UTILIS_LOG_AT(Level::DEB, __VA_ARGS__)
+#define UTILIS_LOG_INFO(...) UTILIS_LOG_AT(Level::INFO, __VA_ARGS__)
+#define UTILIS_LOG_NOTICE(...) UTILIS_LOG_AT(Level::NOTICE, __VA_ARGS__)
+#define UTILIS_LOG_WARNING(...) UTILIS_LOG_AT(Level::WARNING, __VA_ARGS__)
+#define UTILIS_LOG_ERROR(...) UTILIS_LOG_AT(Level::ERR, __VA_ARGS__)
+#define UTILIS_LOG_CRITICAL(...) UTILIS_LOG_AT(Level::CRIT, __VA_ARGS__)
+#define UTILIS_LOG_ALERT(...) UTILIS_LOG_AT(Level::ALERT, __VA_ARGS__)
+#define UTILIS_LOG_EMERGENCY(...) UTILIS_LOG_AT(Level::EMERG, __VA_ARGS__)
+
+// Format variants: UTILIS_LOGF_INFO("req {} took {} us", id, us).
+// The format must be a string literal, its placeholder count is checked against the arguments at compile time.
+#define UTILIS_LOGF_FIRST(...) UTILIS_LOGF_FIRST_(__VA_ARGS__, 0)
+#define UTILIS_LOGF_FIRST_(first, ...) first
+#define UTILIS_LOGF_AT(level, ...)                                                                                  \
+    do {                                                                                                            \
+        static_assert(logFormatPlaceholders(UTILIS_LOGF_FIRST(__VA_ARGS__))                                         \
+                == decltype(logFormatArgCount(__VA_ARGS__))::value - 1,                                             \
+            "log format placeholder count does not match the number of arguments");                                 \
+        if (UTILIS_LOG_COMPILED(level) && logger.isEnabled(level)) {                                                \
+            logger.logFormat(level, std::experimental::source_location::current(), __VA_ARGS__);                    \
+        }                                                                                                           \
+    } while (0)
+
+#define UTILIS_LOGF_DEBUG(...) UTILIS_LOGF_AT(Level::DEB, __VA_ARGS__)
+#define UTILIS_LOGF_INFO(...) UTILIS_LOGF_AT(Level::INFO, __VA_ARGS__)
+#define UTILIS_LOGF_NOTICE(...) UTILIS_LOGF_AT(Level::NOTICE, __VA_ARGS__)
+#define UTILIS_LOGF_WARNING(...) UTILIS_LOGF_AT(Level::WARNING, __VA_ARGS__)
+#define UTILIS_LOGF_ERROR(...) UTILIS_LOGF_AT(Level::ERR, __VA_ARGS__)
+#define UTILIS_LOGF_CRITICAL(...) UTILIS_LOGF_AT(Level::CRIT, __VA_ARGS__)
+#define UTILIS_LOGF_ALERT(...) UTILIS_LOGF_AT(Level::ALERT, __VA_ARGS__)
+#define UTILIS_LOGF_EMERGENCY(...) UTILIS_LOGF_AT(Level::EMERG, __VA_ARGS__)
+
+// Category variants: UTILIS_CLOGF_DEBUG(net, "sent {} bytes", n), the level check is the category's.
+#define UTILIS_CLOGF_AT(category, level, ...)                                                                       \
+    do {                                                                                                            \
+        static_assert(logFormatPlaceholders(UTILIS_LOGF_FIRST(__VA_ARGS__))                                         \
+                == decltype(logFormatArgCount(__VA_ARGS__))::value - 1,                                             \
+            "log format placeholder count does not match the number of arguments");                                 \
+        if (UTILIS_LOG_COMPILED(level) && (category).isEnabled(level)) {                                            \
+            (category).logFormat(level, std::experimental::source_location::current(), __VA_ARGS__);                \
+        }                                                                                                           \
+    } while (0)
+
+#define UTILIS_CLOGF_DEBUG(category, ...) UTILIS_CLOGF_AT(category, Level::DEB, __VA_ARGS__)
+#define UTILIS_CLOGF_INFO(category, ...) UTILIS_CLOGF_AT(category, Level::INFO, __VA_ARGS__)
+#define UTILIS_CLOGF_NOTICE(category, ...) UTILIS_CLOGF_AT(category, Level::NOTICE, __VA_ARGS__)
+#define UTILIS_CLOGF_WARNING(category, ...) UTILIS_CLOGF_AT(category, Level::WARNING, __VA_ARGS__)
+#define UTILIS_CLOGF_ERROR(category, ...) UTILIS_CLOGF_AT(category, Level::ERR, __VA_ARGS__)
+#define UTILIS_CLOGF_CRITICAL(category, ...) UTILIS_CLOGF_AT(category, Level::CRIT, __VA_ARGS__)
+#define UTILIS_CLOGF_ALERT(category, ...) UTILIS_CLOGF_AT(category, Level::ALERT, __VA_ARGS__)
+#define UTILIS_CLOGF_EMERGENCY(category, ...) UTILIS_CLOGF_AT(category, Level::EMERG, __VA_ARGS__)
+#pragma endregion Log macros
 // __attribute__ ((warning("unsafe memory management")))
 inline size_t cpyChar(char* dest, const char* src)
 {
@@ -317,26 +1095,10 @@ inline size_t cpyChar(char* dest, const char* src)
     dest[i] = src[i];
     return i;
 }
-// __attribute__ ((warning("unsafe memory management")))
 inline size_t cpyChar(char* dest, unsigned int src)
 {
-    size_t y = 0;
-    char* numbers = (char*)malloc(sizeof(char) * 10);
-
-    while (src >= 10) {
-        numbers[y] = '0' + src % 10;
-        src /= 10;
-        y++;
-    }
-    numbers[y] = static_cast<char>('0' + src);
-    y++;
-    size_t i = 0;
-    for (i = 0; i < y; i++) {
-        dest[i] = numbers[y - i - 1];
-    }
+    size_t i = formatUnsigned(dest, src);
     dest[i] = '\0';
-
-    free(numbers);
     return i;
 }
 
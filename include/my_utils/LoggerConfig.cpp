@@ -0,0 +1,336 @@
+#include "LoggerConfig.hpp"
+#include "iniReader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// the targets a config file controls, the others keep what the program set
+#define loggerConfigTargets ((short)Target::STDOUT | (short)Target::STDERR | (short)Target::LOG_FILE)
+
+namespace {
+bool parseLevel(const std::string& text, Level& level)
+{
+    static const std::pair<const char*, Level> names[] = {
+        { "DEBUG", Level::DEB },
+        { "DEB", Level::DEB },
+        { "INFO", Level::INFO },
+        { "NOTICE", Level::NOTICE },
+        { "WARNING", Level::WARNING },
+        { "WARN", Level::WARNING },
+        { "ERROR", Level::ERR },
+        { "ERR", Level::ERR },
+        { "CRITICAL", Level::CRIT },
+        { "CRIT", Level::CRIT },
+        { "ALERT", Level::ALERT },
+        { "EMERGENCY", Level::EMERG },
+        { "EMERG", Level::EMERG },
+    };
+    for (const auto& name : names) {
+        if (strcasecmp(text.c_str(), name.first) == 0) {
+            level = name.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseBool(const std::string& text, bool& value)
+{
+    for (const char* word : { "true", "yes", "on", "1" }) {
+        if (strcasecmp(text.c_str(), word) == 0) {
+            value = true;
+            return true;
+        }
+    }
+    for (const char* word : { "false", "no", "off", "0" }) {
+        if (strcasecmp(text.c_str(), word) == 0) {
+            value = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseTargets(const std::string& text, short& targets)
+{
+    targets = 0;
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find_first_of(",| ", begin);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string word = text.substr(begin, end - begin);
+        begin = end + 1;
+        if (word.empty()) {
+            continue;
+        }
+        if (strcasecmp(word.c_str(), "stdout") == 0) {
+            targets |= (short)Target::STDOUT;
+        } else if (strcasecmp(word.c_str(), "stderr") == 0) {
+            targets |= (short)Target::STDERR;
+        } else if (strcasecmp(word.c_str(), "file") == 0) {
+            targets |= (short)Target::LOG_FILE;
+        } else if (strcasecmp(word.c_str(), "none") != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+std::string baseNameOf(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+} // namespace
+
+Level LoggerSettings::levelFor(const std::string& category) const
+{
+    for (const auto& entry : this->categoryLevels) {
+        if (entry.first == category) {
+            return entry.second;
+        }
+    }
+    return this->level;
+}
+
+LoggerConfig::LoggerConfig(Logger& target)
+    : owner(target)
+{
+    LoggerState state = target.getState();
+    this->baseline.level = state.level;
+    this->baseline.targets = state.targets & loggerConfigTargets;
+    this->baseline.file = target.LoggerFile;
+    this->baseline.timestamp = state.timestamp;
+    this->baseline.showLevel = state.showLevel;
+    this->baseline.fileInfo = state.fileInfo;
+    this->snapshots.push_back(std::make_unique<LoggerSettings>(this->baseline));
+    this->current.store(this->snapshots.back().get(), std::memory_order_release);
+}
+
+LoggerConfig::~LoggerConfig() { stopWatching(); }
+
+#pragma region Loading
+bool LoggerConfig::load(const std::string& fileName)
+{
+    Utilis::IniReader ini;
+    ini.load(fileName);
+    std::scoped_lock<std::mutex> lock(mxConfig);
+    this->fileName = fileName;
+    return publish(ini);
+}
+
+bool LoggerConfig::reload()
+{
+    std::scoped_lock<std::mutex> lock(mxConfig);
+    if (this->fileName.empty()) {
+        this->errors.assign(1, "no file loaded");
+        return false;
+    }
+    Utilis::IniReader ini;
+    ini.load(this->fileName);
+    return publish(ini);
+}
+
+bool LoggerConfig::apply(const std::string& text)
+{
+    Utilis::IniReader ini;
+    ini.parse(text);
+    std::scoped_lock<std::mutex> lock(mxConfig);
+    return publish(ini);
+}
+
+std::vector<std::string> LoggerConfig::getErrors() const
+{
+    std::scoped_lock<std::mutex> lock(mxConfig);
+    return this->errors;
+}
+
+bool LoggerConfig::publish(const Utilis::IniReader& ini)
+{
+    const LoggerSettings& previous = this->settings();
+    auto next = std::make_unique<LoggerSettings>(this->baseline);
+    // unreadable files and syntax errors are reported here, build() adds what the values get wrong
+    this->errors = ini.getErrors();
+    if (!build(ini, *next) || !applyToLogger(previous, *next)) {
+        std::string prefix = this->fileName.empty() ? "" : this->fileName + ": ";
+        for (const std::string& error : this->errors) {
+            this->owner.write(Level::WARNING, ("LoggerConfig: " + prefix + error + ", configuration not changed").c_str(),
+                std::experimental::source_location::current());
+        }
+        return false;
+    }
+    next->generation = previous.generation + 1;
+    this->snapshots.push_back(std::move(next));
+    this->current.store(this->snapshots.back().get(), std::memory_order_release);
+    return true;
+}
+
+bool LoggerConfig::build(const Utilis::IniReader& ini, LoggerSettings& next)
+{
+    for (const auto& entry : ini.getEntries("logger")) {
+        const std::string& key = entry.first;
+        const std::string& value = entry.second;
+        bool valid = true;
+        if (strcasecmp(key.c_str(), "level") == 0) {
+            valid = parseLevel(value, next.level);
+        } else if (strcasecmp(key.c_str(), "targets") == 0) {
+            valid = parseTargets(value, next.targets);
+        } else if (strcasecmp(key.c_str(), "file") == 0) {
+            next.file = value;
+            valid = !value.empty();
+        } else if (strcasecmp(key.c_str(), "timestamp") == 0) {
+            valid = parseBool(value, next.timestamp);
+        } else if (strcasecmp(key.c_str(), "show_level") == 0) {
+            valid = parseBool(value, next.showLevel);
+        } else if (strcasecmp(key.c_str(), "file_info") == 0) {
+            valid = parseBool(value, next.fileInfo);
+        } else {
+            this->errors.push_back("[logger] unknown key '" + key + "'");
+            continue;
+        }
+        if (!valid) {
+            this->errors.push_back("[logger] bad value '" + value + "' for " + key);
+        }
+    }
+    for (const auto& entry : ini.getEntries("levels")) {
+        Level level;
+        if (!parseLevel(entry.second, level)) {
+            this->errors.push_back("[levels] bad level '" + entry.second + "' for " + entry.first);
+            continue;
+        }
+        // a repeated name overrides the earlier one
+        auto found = std::find_if(next.categoryLevels.begin(), next.categoryLevels.end(),
+            [&entry](const std::pair<std::string, Level>& known) { return known.first == entry.first; });
+        if (found != next.categoryLevels.end()) {
+            found->second = level;
+        } else {
+            next.categoryLevels.emplace_back(entry.first, level);
+        }
+    }
+    return this->errors.empty();
+}
+
+bool LoggerConfig::applyToLogger(const LoggerSettings& previous, const LoggerSettings& next)
+{
+    Logger& target = this->owner;
+    // the new file is open before any line is routed to it, LOG_FILE itself is switched on by setState()
+    if (next.targets & (short)Target::LOG_FILE && !target.switchFileIfChanged(next.file)) {
+        this->errors.push_back("[logger] cannot open file '" + next.file + "'");
+        return false;
+    }
+    std::vector<std::pair<std::string, Level>> categoryLevels = next.categoryLevels;
+    // categories dropped from the file follow the global level again
+    for (const auto& entry : previous.categoryLevels) {
+        if (std::none_of(next.categoryLevels.begin(), next.categoryLevels.end(),
+                [&entry](const std::pair<std::string, Level>& kept) { return kept.first == entry.first; })) {
+            categoryLevels.emplace_back(entry.first, next.level);
+        }
+    }
+    // one store, every record is written with either all of the old or all of the new settings
+    LoggerState state = target.getState();
+    state.level = next.level;
+    state.targets = (short)((state.targets & ~loggerConfigTargets) | next.targets);
+    state.timestamp = next.timestamp;
+    state.showLevel = next.showLevel;
+    state.fileInfo = next.fileInfo;
+    target.setState(state, categoryLevels);
+    return true;
+}
+#pragma endregion Loading
+
+#pragma region Watching
+bool LoggerConfig::watch()
+{
+    std::scoped_lock<std::mutex> lock(mxConfig);
+    if (this->watcher.joinable()) {
+        return true;
+    }
+    if (this->fileName.empty()) {
+        return false;
+    }
+    int inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotifyFd < 0) {
+        return false;
+    }
+    // editors and config management save by writing a new file and renaming it over the old one,
+    // a watch on the file itself would stay on the replaced inode
+    if (inotify_add_watch(inotifyFd, directoryOf(this->fileName).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+            < 0
+        || pipe2(this->stopPipe, O_CLOEXEC) != 0) {
+        close(inotifyFd);
+        return false;
+    }
+    this->watcher = std::thread(&LoggerConfig::watchLoop, this, inotifyFd);
+    return true;
+}
+
+void LoggerConfig::stopWatching()
+{
+    if (!this->watcher.joinable()) {
+        return;
+    }
+    char stop = 1;
+    // the pipe is ours and empty, the write can't block or fail
+    (void)!::write(this->stopPipe[1], &stop, 1);
+    this->watcher.join();
+    close(this->stopPipe[0]);
+    close(this->stopPipe[1]);
+    this->stopPipe[0] = this->stopPipe[1] = -1;
+}
+
+void LoggerConfig::watchLoop(int inotifyFd)
+{
+    std::string name;
+    {
+        std::scoped_lock<std::mutex> lock(mxConfig);
+        name = baseNameOf(this->fileName);
+    }
+    alignas(struct inotify_event) char events[4096];
+    pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { this->stopPipe[0], POLLIN, 0 } };
+    bool changed = false;
+    for (;;) {
+        // once something changed, wait until the file has been quiet for a moment before reading it
+        int ready = poll(fds, 2, changed ? loggerConfigDebounceMs : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (ready == 0) {
+            changed = false;
+            reload();
+            continue;
+        }
+        ssize_t size;
+        while ((size = read(inotifyFd, events, sizeof(events))) > 0) {
+            for (char* at = events; at < events + size;) {
+                const struct inotify_event* event = (const struct inotify_event*)at;
+                if (event->len && name == event->name) {
+                    changed = true;
+                }
+                at += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+    close(inotifyFd);
+}
+#pragma endregion Watching
@@ -0,0 +1,133 @@
+#ifndef LOGGER_CONFIG_HPP
+#define LOGGER_CONFIG_HPP
+
+#include "Logger.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Utilis {
+class IniReader;
+}
+
+// How long the file has to stay quiet after a change before it is reloaded
+#define loggerConfigDebounceMs 100
+
+// One complete Logger configuration. Never changed once published, a reload publishes a new one.
+struct LoggerSettings {
+    Level level = Level::INFO;
+    // STDOUT | STDERR | LOG_FILE bits, LOG_BINARY and LOG_MMAP are left to the program
+    short targets = 0;
+    std::string file;
+    bool timestamp = true;
+    bool showLevel = true;
+    bool fileInfo = false;
+    // [levels] section, in file order
+    std::vector<std::pair<std::string, Level>> categoryLevels;
+    // 0 for what the Logger had before the first load(), +1 per applied file
+    uint64_t generation = 0;
+
+    /* Level configured for a category, the global level if it has none.
+     *
+     * \param	string	Category name
+     * \return	Level	The level
+     */
+    Level levelFor(const std::string& category) const;
+};
+
+// Drives a Logger from an INI file and reloads it when the file changes:
+//   [logger]
+//   level = INFO                 DEBUG, INFO, NOTICE, WARNING, ERROR, CRITICAL, ALERT, EMERGENCY
+//   targets = stdout, file       stdout, stderr, file or none
+//   file = /var/log/app.log
+//   timestamp = on
+//   show_level = on
+//   file_info = off
+//   [levels]
+//   net = DEBUG                  level of Logger::category("net")
+// Keys that are left out fall back to what the Logger had when the LoggerConfig was created.
+// A file with any error is rejected as a whole and the current configuration stays.
+//
+// Each load builds a new LoggerSettings and publishes it with one atomic pointer store, settings() and levelFor()
+// read it without a lock. Replaced snapshots stay alive until the LoggerConfig is destroyed because a thread may
+// still hold one; configurations are small and rarely reloaded so this stays small. The Logger gets the level,
+// targets, style flags and category levels in a single Logger::setState(), so no line mixes old and new settings.
+class LoggerConfig {
+public:
+    /* \param	Logger	The Logger to configure, must outlive the LoggerConfig
+     */
+    explicit LoggerConfig(Logger& target = logger);
+    LoggerConfig(const LoggerConfig&) = delete;
+    LoggerConfig& operator=(const LoggerConfig&) = delete;
+    // stops watching
+    ~LoggerConfig();
+
+    /* Read a file and apply it to the Logger.
+     *
+     * \param	string	INI file
+     * \return	bool	false if it can't be read or has errors, see getErrors(). Nothing is applied then.
+     */
+    bool load(const std::string& fileName);
+
+    /* Read the file given to load() again.
+     *
+     * \return	bool	false if it can't be read or has errors, the current configuration stays
+     */
+    bool reload();
+
+    /* Apply INI text, as load() does with a file's content.
+     *
+     * \param	string	INI text
+     * \return	bool	false if it has errors
+     */
+    bool apply(const std::string& text);
+
+    /* Reload on a background thread whenever the file given to load() is written, replaced or created.
+     * The directory is watched with inotify so editors that save by renaming a new file over the old one are seen.
+     *
+     * \return	bool	false if no file was loaded or inotify isn't available
+     */
+    bool watch();
+    void stopWatching();
+    bool isWatching() const { return this->watcher.joinable(); }
+
+    /* The configuration currently in effect, lock free. Stays valid as long as the LoggerConfig.
+     *
+     * \return	LoggerSettings	The current snapshot
+     */
+    const LoggerSettings& settings() const { return *this->current.load(std::memory_order_acquire); }
+
+    Level levelFor(const std::string& category) const { return this->settings().levelFor(category); }
+
+    /* Problems found by the last load(), reload() or apply(), "line 3: ..." style.
+     *
+     * \return	vector	Messages, empty if it succeeded
+     */
+    std::vector<std::string> getErrors() const;
+
+private:
+    Logger& owner;
+    std::atomic<const LoggerSettings*> current;
+    // mxConfig guards everything below
+    mutable std::mutex mxConfig;
+    std::vector<std::unique_ptr<LoggerSettings>> snapshots;
+    // what the Logger had before the first load, used for keys a file leaves out
+    LoggerSettings baseline;
+    std::string fileName;
+    std::vector<std::string> errors;
+
+    std::thread watcher;
+    int stopPipe[2] = { -1, -1 };
+
+    bool build(const Utilis::IniReader& ini, LoggerSettings& next);
+    bool publish(const Utilis::IniReader& ini);
+    // false if the file can't be opened, nothing is changed then
+    bool applyToLogger(const LoggerSettings& previous, const LoggerSettings& next);
+    void watchLoop(int inotifyFd);
+};
+
+#endif // LOGGER_CONFIG_HPP
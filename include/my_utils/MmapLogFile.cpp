@@ -0,0 +1,165 @@
+#include "MmapLogFile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MmapLogFile::open(const std::string& fileName, size_t chunkSize)
+{
+    std::unique_lock<std::shared_mutex> lock(mxOpen);
+    closeLocked();
+    int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    this->chunkSize = std::max(pageSize, (chunkSize + pageSize - 1) / pageSize * pageSize);
+    this->descriptor = fd;
+    this->fileLength = (uint64_t)fileStat.st_size;
+    this->cursor.store(this->fileLength, std::memory_order_relaxed);
+    this->limit.store(UINT64_MAX, std::memory_order_relaxed);
+    this->dropped.store(0, std::memory_order_relaxed);
+    this->slots = std::make_unique<Slot[]>(mmapWindowChunks);
+    // the existing content counts as already written
+    this->firstChunk = this->fileLength / this->chunkSize;
+    this->firstOffset = (size_t)(this->fileLength % this->chunkSize);
+    return true;
+}
+
+void MmapLogFile::close()
+{
+    std::unique_lock<std::shared_mutex> lock(mxOpen);
+    closeLocked();
+}
+
+void MmapLogFile::closeLocked()
+{
+    if (descriptor < 0) {
+        return;
+    }
+    for (size_t i = 0; i < mmapWindowChunks; i++) {
+        char* mapped = slots[i].mapped.load(std::memory_order_relaxed);
+        if (mapped) {
+            munmap(mapped, chunkSize);
+        }
+    }
+    if (ftruncate(descriptor, (off_t)size()) != 0) {
+        // nothing sensible to do, the tail just stays zero filled
+    }
+    ::close(descriptor);
+    descriptor = -1;
+    slots.reset();
+}
+
+char* MmapLogFile::mapChunk(uint64_t index, std::unique_lock<std::mutex>& lock, bool wait)
+{
+    // called with mxMap held
+    Slot& slot = slots[index % mmapWindowChunks];
+    for (uint64_t held = slot.index.load(std::memory_order_acquire); held != index && held != mmapFreeSlot;
+         held = slot.index.load(std::memory_order_acquire)) {
+        // the chunk a window back is still being copied into, or will never complete because its tail was dropped
+        if (!wait || index * chunkSize >= limit.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        cvSlot.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    if (slot.index.load(std::memory_order_relaxed) == index) {
+        return slot.mapped.load(std::memory_order_relaxed);
+    }
+    // mapping ahead can come after the chunk was already filled and unmapped
+    if (slot.done != mmapFreeSlot && index <= slot.done) {
+        return nullptr;
+    }
+    uint64_t end = (index + 1) * chunkSize;
+    if (end > fileLength) {
+        if (ftruncate(descriptor, (off_t)end) != 0) {
+            return nullptr;
+        }
+        fileLength = end;
+    }
+    void* address = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, (off_t)(index * chunkSize));
+    if (address == MAP_FAILED) {
+        return nullptr;
+    }
+    char* mapped = static_cast<char*>(address);
+    slot.committed.store(index == firstChunk ? firstOffset : 0, std::memory_order_relaxed);
+    slot.mapped.store(mapped, std::memory_order_relaxed);
+    slot.index.store(index, std::memory_order_release);
+    return mapped;
+}
+
+char* MmapLogFile::chunk(uint64_t index)
+{
+    Slot& slot = slots[index % mmapWindowChunks];
+    if (slot.index.load(std::memory_order_acquire) == index) {
+        return slot.mapped.load(std::memory_order_relaxed);
+    }
+    std::unique_lock<std::mutex> lock(mxMap);
+    char* mapped = mapChunk(index, lock, true);
+    // stay one chunk ahead so the next writer doesn't stall on ftruncate+mmap
+    if (mapped) {
+        mapChunk(index + 1, lock, false);
+    }
+    return mapped;
+}
+
+void MmapLogFile::fail(uint64_t position)
+{
+    uint64_t current = limit.load(std::memory_order_relaxed);
+    while (position < current && !limit.compare_exchange_weak(current, position, std::memory_order_acq_rel)) {
+    }
+}
+
+bool MmapLogFile::write(const char* data, size_t size)
+{
+    std::shared_lock<std::shared_mutex> lock(mxOpen);
+    if (descriptor < 0 || size == 0) {
+        return true;
+    }
+    uint64_t start = cursor.fetch_add(size, std::memory_order_relaxed);
+    uint64_t end = start + size;
+    if (end > limit.load(std::memory_order_acquire)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    for (uint64_t position = start; position < end;) {
+        uint64_t index = position / chunkSize;
+        size_t offset = (size_t)(position % chunkSize);
+        size_t count = (size_t)std::min<uint64_t>(end - position, chunkSize - offset);
+        char* mapped = chunk(index);
+        if (!mapped) {
+            // the file ends before this line, what was copied of it already is cut off by close()
+            fail(start);
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        memcpy(mapped + offset, data, count);
+        // the writer that completes a chunk unmaps it, nobody else can still be copying into it
+        Slot& slot = slots[index % mmapWindowChunks];
+        if (slot.committed.fetch_add(count, std::memory_order_acq_rel) + count == chunkSize) {
+            std::scoped_lock<std::mutex> mapLock(mxMap);
+            munmap(mapped, chunkSize);
+            slot.mapped.store(nullptr, std::memory_order_relaxed);
+            slot.done = index;
+            slot.index.store(mmapFreeSlot, std::memory_order_release);
+            cvSlot.notify_all();
+        }
+        position += count;
+        data += count;
+    }
+    // a mapping failed further back while this line was copied, close() cuts it off
+    if (end > limit.load(std::memory_order_acquire)) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
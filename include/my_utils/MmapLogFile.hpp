@@ -0,0 +1,95 @@
+#ifndef MMAP_LOG_FILE_HPP
+#define MMAP_LOG_FILE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+// Log file written through shared memory mappings, used by the LOG_MMAP target.
+// Writers reserve their range with one fetch_add on the cursor and copy straight into the mapping,
+// so concurrent lines never wait on each other. The file is extended and mapped in large chunks
+// (the next chunk is mapped ahead of time), finished chunks are unmapped by the writer that completes them,
+// and close() truncates the file to the bytes actually written.
+// Mapped chunks live in a window of slots reused round robin, chunk i in slot i % mmapWindowChunks.
+// If a chunk can't be mapped (disk full, address space) the file stops at the line that failed:
+// that line and every later one is dropped and counted, close() truncates before it.
+class MmapLogFile {
+public:
+#define mmapDefaultChunkSize (16 * 1024 * 1024)
+#define mmapWindowChunks 64
+#define mmapFreeSlot UINT64_MAX
+    MmapLogFile() = default;
+    MmapLogFile(const MmapLogFile&) = delete;
+    MmapLogFile& operator=(const MmapLogFile&) = delete;
+    ~MmapLogFile() { close(); }
+
+    /* Open (append) a file.
+     *
+     * \param	string	File name
+     * \param	size_t	Mapping/extension granularity, rounded up to the page size
+     * \return	bool	false if the file could not be opened
+     */
+    bool open(const std::string& fileName, size_t chunkSize = mmapDefaultChunkSize);
+
+    /* Unmap everything and truncate the file to its real length.
+     */
+    void close();
+    bool is_open() const { return descriptor >= 0; }
+
+    /* Copy data into the file, safe to call from many threads at once.
+     *
+     * \return	bool	false if the line was dropped because a chunk could not be mapped
+     */
+    bool write(const char* data, size_t size);
+
+    /* Real length of the file (written or reserved bytes).
+     */
+    uint64_t size() const
+    {
+        return std::min(cursor.load(std::memory_order_relaxed), limit.load(std::memory_order_relaxed));
+    }
+
+    size_t getChunkSize() const { return chunkSize; }
+
+    /* Lines dropped since open() because a chunk could not be mapped.
+     */
+    uint64_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    int descriptor = -1;
+    size_t chunkSize = mmapDefaultChunkSize;
+    uint64_t fileLength = 0;
+    std::atomic<uint64_t> cursor { 0 };
+    // where the file ends after a failed mapping, nothing at or past it is written
+    std::atomic<uint64_t> limit { UINT64_MAX };
+    std::atomic<uint64_t> dropped { 0 };
+    // the chunk open() appends to and how much of it the file already held
+    uint64_t firstChunk = 0;
+    size_t firstOffset = 0;
+    struct Slot {
+        std::atomic<uint64_t> index { mmapFreeSlot }; // chunk mapped into the slot
+        std::atomic<char*> mapped { nullptr };
+        std::atomic<uint64_t> committed { 0 }; // bytes of the chunk written so far
+        uint64_t done = mmapFreeSlot; // last chunk unmapped from the slot, guarded by mxMap
+    };
+    std::unique_ptr<Slot[]> slots;
+    // writers hold it shared, open()/close() exclusive
+    std::shared_mutex mxOpen;
+    // serializes extending the file and mapping chunks
+    std::mutex mxMap;
+    // signalled when a chunk is unmapped and its slot is free again
+    std::condition_variable cvSlot;
+
+    char* chunk(uint64_t index);
+    char* mapChunk(uint64_t index, std::unique_lock<std::mutex>& lock, bool wait);
+    void fail(uint64_t position);
+    void closeLocked();
+};
+
+#endif // MMAP_LOG_FILE_HPP
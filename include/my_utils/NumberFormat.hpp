@@ -0,0 +1,130 @@
+#ifndef NUMBER_FORMAT_HPP
+#define NUMBER_FORMAT_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+
+// Allocation free number to text kernels shared by the Logger and the Profiler.
+// Each writes into a caller provided buffer of at least numberFormatMaxChars and returns the length,
+// nothing is 0 terminated.
+#define numberFormatMaxChars 32
+
+// "00" "01" ... "99", integers are written two digits per division
+inline constexpr char numberDigitPairs[201] = "00010203040506070809"
+                                              "10111213141516171819"
+                                              "20212223242526272829"
+                                              "30313233343536373839"
+                                              "40414243444546474849"
+                                              "50515253545556575859"
+                                              "60616263646566676869"
+                                              "70717273747576777879"
+                                              "80818283848586878889"
+                                              "90919293949596979899";
+
+inline size_t countDigits(uint64_t value)
+{
+    size_t count = 1;
+    for (;;) {
+        if (value < 10) {
+            return count;
+        }
+        if (value < 100) {
+            return count + 1;
+        }
+        if (value < 1000) {
+            return count + 2;
+        }
+        if (value < 10000) {
+            return count + 3;
+        }
+        value /= 10000;
+        count += 4;
+    }
+}
+
+/* Decimal digits of an unsigned value.
+ *
+ * \param	char*	Output buffer
+ * \param	uint64_t	The value
+ * \return	size_t	Number of characters written
+ */
+inline size_t formatUnsigned(char* out, uint64_t value)
+{
+    size_t length = countDigits(value);
+    // right to left, the length is known up front
+    char* at = out + length;
+    while (value >= 100) {
+        size_t pair = (size_t)(value % 100) * 2;
+        value /= 100;
+        *--at = numberDigitPairs[pair + 1];
+        *--at = numberDigitPairs[pair];
+    }
+    if (value >= 10) {
+        *--at = numberDigitPairs[value * 2 + 1];
+        *--at = numberDigitPairs[value * 2];
+    } else {
+        *--at = static_cast<char>('0' + value);
+    }
+    return length;
+}
+
+inline size_t formatSigned(char* out, int64_t value)
+{
+    if (value < 0) {
+        *out = '-';
+        // negate as unsigned so INT64_MIN doesn't overflow
+        return 1 + formatUnsigned(out + 1, 0 - (uint64_t)value);
+    }
+    return formatUnsigned(out, (uint64_t)value);
+}
+
+/* Zero padded to a fixed number of digits, higher digits are cut off.
+ *
+ * \param	char*	Output buffer
+ * \param	uint64_t	The value
+ * \param	size_t	Number of digits to write
+ * \return	size_t	digits
+ */
+inline size_t formatPadded(char* out, uint64_t value, size_t digits)
+{
+    char* at = out + digits;
+    while (at - out >= 2) {
+        size_t pair = (size_t)(value % 100) * 2;
+        value /= 100;
+        *--at = numberDigitPairs[pair + 1];
+        *--at = numberDigitPairs[pair];
+    }
+    if (at != out) {
+        *--at = static_cast<char>('0' + value % 10);
+    }
+    return digits;
+}
+
+// Lowercase hex without a prefix.
+inline size_t formatHex(char* out, uint64_t value)
+{
+    size_t length = 1;
+    for (uint64_t rest = value >> 4; rest; rest >>= 4) {
+        length++;
+    }
+    for (size_t i = length; i > 0; i--) {
+        out[i - 1] = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    }
+    return length;
+}
+
+/* Shortest text that parses back to the same double ("0.1", "1e+20", "inf", "nan").
+ * Uses std::to_chars, the standard library's shortest round trip algorithm.
+ *
+ * \param	char*	Output buffer
+ * \param	double	The value
+ * \return	size_t	Number of characters written
+ */
+inline size_t formatDouble(char* out, double value)
+{
+    return (size_t)(std::to_chars(out, out + numberFormatMaxChars, value).ptr - out);
+}
+
+#endif // NUMBER_FORMAT_HPP
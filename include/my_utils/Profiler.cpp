@@ -1,4 +1,5 @@
 #include "Profiler.hpp"
+#include "NumberFormat.hpp"
 #include <chrono>
 #include <ctime>
 #include <fcntl.h>
@@ -17,18 +18,20 @@ Profiler* Profiler::getInstance()
     return instance_;
 }
 
-void Profiler::AddSample(Sample sample)
+ProfilerSlot* Profiler::intern(const std::string& name)
 {
     std::scoped_lock<std::mutex> lock(mxSamples);
-    for (auto& sampleTmp : samples) {
-        if (sampleTmp.name == sample.name) {
-            sampleTmp.nsTime += sample.nsTime;
-            return;
-        }
+    auto found = slotIndex.find(name);
+    if (found != slotIndex.end()) {
+        return found->second;
     }
-    samples.push_back(sample);
+    ProfilerSlot* slot = &slots.emplace_back(name);
+    slotIndex.emplace(name, slot);
+    return slot;
 }
 
+void Profiler::AddSample(Sample sample) { AddSample(intern(sample.name), sample.nsTime); }
+
 std::string Profiler::getTimingsAsString(bool doClearSamples)
 {
     std::string retString = "";
@@ -38,17 +41,22 @@ std::string Profiler::getTimingsAsString(bool doClearSamples)
 
     std::vector<Sample> localSamples = getTimings(doClearSamples);
     long time = 0;
+    char number[numberFormatMaxChars];
+    retString.reserve(retString.size() + localSamples.size() * 64);
     for (auto const& localSample : localSamples) {
         retString += localSample.name;
         retString += ": ";
         time = localSample.nsTime;
-        retString += std::to_string(time) + "ns.  ";
+        retString.append(number, formatSigned(number, time));
+        retString += "ns.  ";
         time /= 1000000; // change to ms.
         if (time >= 1) {
-            retString += std::to_string(time) + "ms.  ";
+            retString.append(number, formatSigned(number, time));
+            retString += "ms.  ";
             time /= 1000; // change to s.
             if (time >= 1) {
-                retString += std::to_string(time) + "s.";
+                retString.append(number, formatSigned(number, time));
+                retString += "s.";
             }
         }
         retString += "\n";
@@ -64,13 +72,16 @@ std::vector<Sample> Profiler::getTimings(bool doClearSamples)
 {
     std::vector<Sample> retSample;
 
-    mxSamples.lock();
-    for (auto const& sample : samples) {
-        retSample.emplace_back(sample);
-    }
-    mxSamples.unlock();
-    if (doClearSamples) {
-        clearSamples();
+    std::scoped_lock<std::mutex> lock(mxSamples);
+    for (auto& slot : slots) {
+        // slots stay, timers hold pointers to them, clearing only zeroes the totals
+        long hits = doClearSamples ? slot.hits.exchange(0, std::memory_order_relaxed)
+                                   : slot.hits.load(std::memory_order_relaxed);
+        long nsTime = doClearSamples ? slot.nsTime.exchange(0, std::memory_order_relaxed)
+                                     : slot.nsTime.load(std::memory_order_relaxed);
+        if (hits) {
+            retSample.emplace_back(slot.name, nsTime);
+        }
     }
 
     return retSample;
@@ -79,17 +90,53 @@ std::vector<Sample> Profiler::getTimings(bool doClearSamples)
 void Profiler::clearSamples()
 {
     std::scoped_lock<std::mutex> lock(mxSamples);
-    samples.clear();
+    for (auto& slot : slots) {
+        slot.hits.store(0, std::memory_order_relaxed);
+        slot.nsTime.store(0, std::memory_order_relaxed);
+    }
 }
 
 void Profiler::printProfilerData(bool doClearSamples)
 {
-    for (size_t i = 0; i < samples.size(); i++) {
-        std::cout << samples[i].name << ": " << samples[i].nsTime << "ns" << std::endl;
+    for (auto const& sample : getTimings(doClearSamples)) {
+        std::cout << sample.name << ": " << sample.nsTime << "ns" << std::endl;
+    }
+    for (auto const& counter : getCounters()) {
+        std::cout << counter.name << ": " << counter.value << std::endl;
     }
-    if (doClearSamples) {
-        clearSamples();
+}
+
+void Profiler::AddCounter(const std::string& name, std::function<long()> read)
+{
+    std::scoped_lock<std::mutex> lock(mxCounters);
+    for (auto& counter : counters) {
+        if (counter.first == name) {
+            counter.second = std::move(read);
+            return;
+        }
     }
+    counters.emplace_back(name, std::move(read));
+}
+
+void Profiler::RemoveCounter(const std::string& name)
+{
+    std::scoped_lock<std::mutex> lock(mxCounters);
+    for (auto it = counters.begin(); it != counters.end(); it++) {
+        if (it->first == name) {
+            counters.erase(it);
+            return;
+        }
+    }
+}
+
+std::vector<Counter> Profiler::getCounters()
+{
+    std::vector<Counter> values;
+    std::scoped_lock<std::mutex> lock(mxCounters);
+    for (auto const& counter : counters) {
+        values.push_back(Counter { counter.first, counter.second() });
+    }
+    return values;
 }
 
 Profiler::~Profiler()
@@ -103,13 +150,30 @@ Profiler::~Profiler()
 Profiler* Profiler::instance_;
 
 PTimer::PTimer(const std::string& name)
+    : PTimer(Profiler::getInstance()->intern(name))
+{
+}
+
+PTimer::PTimer(ProfilerSite& site, std::string_view name)
+{
+    ProfilerSlot* cached = site.slot.load(std::memory_order_acquire);
+    // a compare instead of a hash and a lock, names built at run time still end up in their own slot
+    if (!cached || cached->name != name) {
+        cached = Profiler::getInstance()->intern(std::string(name));
+        site.slot.store(cached, std::memory_order_release);
+    }
+    this->slot = cached;
+    startTime = std::chrono::high_resolution_clock::now();
+}
+
+PTimer::PTimer(ProfilerSlot* slot)
+    : slot(slot)
 {
-    sample.name = name;
     startTime = std::chrono::high_resolution_clock::now();
 }
 
 PTimer::~PTimer()
 {
-    sample.nsTime = std::chrono::duration<long, std::nano>(std::chrono::high_resolution_clock::now() - startTime).count();
-    Profiler::getInstance()->AddSample(sample);
+    long nsTime = std::chrono::duration<long, std::nano>(std::chrono::high_resolution_clock::now() - startTime).count();
+    Profiler::getInstance()->AddSample(this->slot, nsTime);
 }
@@ -1,9 +1,14 @@
 #ifndef PROFILER_HPP
 #define PROFILER_HPP
 
+#include <atomic>
 #include <chrono>
+#include <deque>
+#include <functional>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 struct Sample {
     long nsTime;
@@ -20,10 +25,36 @@ struct Sample {
     }
 };
 
+// Running total of one timer name, see Profiler::intern(). Lives as long as the Profiler.
+struct ProfilerSlot {
+    explicit ProfilerSlot(std::string const& name)
+        : name(name)
+    {
+    }
+    const std::string name;
+    std::atomic<long> nsTime { 0 };
+    std::atomic<long> hits { 0 }; // samples since the last clear, slots without any aren't reported
+};
+
+// Slot last used by a newTimer() call site, see PTimer(ProfilerSite&, std::string_view).
+struct ProfilerSite {
+    std::atomic<ProfilerSlot*> slot { nullptr };
+};
+
+// A value reported next to the timings, see Profiler::AddCounter().
+struct Counter {
+    std::string name;
+    long value;
+};
+
 class Profiler {
 private:
     std::mutex mxSamples;
-    std::vector<Sample> samples;
+    // slots in the order their names were first seen, the index only for intern()
+    std::deque<ProfilerSlot> slots;
+    std::unordered_map<std::string, ProfilerSlot*> slotIndex;
+    std::mutex mxCounters;
+    std::vector<std::pair<std::string, std::function<long()>>> counters;
     static Profiler* instance_;
     ~Profiler();
     Profiler();
@@ -33,23 +64,54 @@ public:
     Profiler(Profiler& other) = delete;
     void operator=(const Profiler&) = delete;
 
+    /* The slot a timer name adds to, created on first use. Hashes the name and takes a lock,
+     * do it once per name and keep the pointer.
+     *
+     * \param	string	Timer name
+     * \return	ProfilerSlot	Valid until the Profiler is destroyed
+     */
+    ProfilerSlot* intern(const std::string& name);
+
+    // Interns sample.name on every call, AddSample(ProfilerSlot*, long) is the fast path.
     void AddSample(Sample sample);
+    // Lock free, two relaxed atomic adds.
+    void AddSample(ProfilerSlot* slot, long nsTime)
+    {
+        slot->nsTime.fetch_add(nsTime, std::memory_order_relaxed);
+        slot->hits.fetch_add(1, std::memory_order_relaxed);
+    }
 
     std::string getTimingsAsString(bool doClearSamples = true);
     std::vector<Sample> getTimings(bool doClearSamples = true);
 
     void clearSamples();
     void printProfilerData(bool doClearSamples = true);
+
+    /* Report a value next to the timings, read each time the counters are asked for.
+     * A counter with the same name is replaced.
+     *
+     * \param	string	Name of the counter
+     * \param	function	Returns the current value
+     */
+    void AddCounter(const std::string& name, std::function<long()> read);
+    void RemoveCounter(const std::string& name);
+    std::vector<Counter> getCounters();
 };
 
 // use for acurate creation to block end timing cant be used in return scope //TODO deal with that problem
 #define TOKENPASTE(x, y) x##y
 #define TOKENPASTE2(x, y) TOKENPASTE(x, y)
-#define newTimer(name) PTimer TOKENPASTE2(Timer_, __COUNTER__) = PTimer(name)
+// each call site caches the slot of the last name it timed, one declaration so it also works as an if/for body
+#define newTimer(name)                                                                                                 \
+    PTimer TOKENPASTE2(Timer_, __COUNTER__)([]() -> ProfilerSite& {                                                    \
+        static ProfilerSite site;                                                                                      \
+        return site;                                                                                                   \
+    }(),                                                                                                               \
+        name)
 // use by throwing newTimer({string name}) into code block, it will measure to the end of a block
 class PTimer {
 private:
-    Sample sample;
+    ProfilerSlot* slot;
 #ifdef APPLE
     std::chrono::high_resolution_clock::time_point startTime;
 #else
@@ -58,6 +120,13 @@ private:
 
 public:
     explicit PTimer(const std::string& name);
+    explicit PTimer(ProfilerSlot* slot);
+    /* Time into the slot cached by a call site, interned again only when the name differs from the cached one.
+     *
+     * \param	ProfilerSite	The call site's cache
+     * \param	string_view	Timer name, may change from call to call
+     */
+    PTimer(ProfilerSite& site, std::string_view name);
     ~PTimer();
 };
 
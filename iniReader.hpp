@@ -1,4 +0,0 @@
-namespace Utilis
-{
-    
-} // namespace Utilis
@@ -0,0 +1,57 @@
+// utilis-logdecode: turn a LOG_BINARY file back into the text lines the Logger would have written.
+// usage: utilis-logdecode <binary log> [output file]
+#include "my_utils/BinaryLog.hpp"
+#include "my_utils/Logger.hpp"
+#include <cstdio>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <binary log> [output file]\n", argv[0]);
+        return 2;
+    }
+    BinaryLogReader reader;
+    if (!reader.open(argv[1])) {
+        fprintf(stderr, "%s: not a binary log file\n", argv[1]);
+        return 1;
+    }
+    FILE* out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "%s: cannot open for writing\n", argv[2]);
+        return 1;
+    }
+
+    // a private Logger only used for its line layout
+    Logger decoder;
+    // the locations point into the reader's strings, not literals
+    decoder.cacheCallSites = false;
+    LineBuffer message;
+    LineBuffer line;
+    BinaryLogEntry entry;
+    LoggerState style;
+    while (reader.next(entry)) {
+        const BinaryLogCallSite& site = *entry.callSite;
+        style.timestamp = entry.flags & BINARY_TIMESTAMP;
+        style.showLevel = entry.flags & BINARY_LEVEL;
+        style.fileInfo = entry.flags & BINARY_FILE_INFO;
+        style.timestampPrecision = (TimestampPrecision)((entry.flags & BINARY_PRECISION_MASK) >> BINARY_PRECISION_SHIFT);
+        style.timestampMode = (TimestampMode)((entry.flags & BINARY_MODE_MASK) >> BINARY_MODE_SHIFT);
+
+        message.clear();
+        formatLogMessage(message, site.hasFormat ? site.format.c_str() : "{}", entry.args.data(), entry.args.size());
+        line.clear();
+        decoder.appendLine(line, (Level)entry.level, message.c_str(),
+            std::experimental::source_location::current(
+                site.file.c_str(), site.function.c_str(), (int)site.line, (int)site.column),
+            entry.timeNs, nullptr, &style);
+        fwrite(line.data, 1, line.size, out);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    if (reader.isCorrupt()) {
+        fprintf(stderr, "%s: stopped at a malformed record\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// utilis-logshm: follow a ShmSink ring and copy its records to stdout, like tail -f for the shared memory channel.
+// usage: utilis-logshm <name> [--from-start]
+#include "my_utils/LogShm.hpp"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+volatile std::sig_atomic_t stopping = 0;
+
+void stop(int)
+{
+    stopping = 1;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <name> [--from-start]\n", argv[0]);
+        return 2;
+    }
+    bool fromStart = argc > 2 && strcmp(argv[2], "--from-start") == 0;
+    LogShmReader reader;
+    if (!reader.open(argv[1], fromStart)) {
+        fprintf(stderr, "%s: no log ring of this version\n", argv[1]);
+        return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    uint64_t overruns = 0;
+    LogShmRecord record;
+    std::vector<char> copy;
+    while (!stopping) {
+        if (!reader.next(record)) {
+            if (reader.getOverrunCount() != overruns) {
+                overruns = reader.getOverrunCount();
+                fprintf(stderr, "utilis-logshm: overrun, %llu bytes lost so far\n",
+                    (unsigned long long)reader.getLostBytes());
+            }
+            fflush(stdout);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        // the writer may lap us while the record is copied, only an intact copy is printed
+        copy.assign(record.data, record.data + record.length);
+        if (!reader.isValid(record)) {
+            fprintf(stderr, "utilis-logshm: record at %llu was overwritten while it was copied, skipped\n",
+                (unsigned long long)record.position);
+            continue;
+        }
+        fwrite(copy.data(), 1, copy.size(), stdout);
+    }
+    fflush(stdout);
+    fprintf(stderr, "utilis-logshm: %llu overruns, %llu bytes lost\n", (unsigned long long)reader.getOverrunCount(),
+        (unsigned long long)reader.getLostBytes());
+    return 0;
+}